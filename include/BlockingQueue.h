@@ -0,0 +1,57 @@
+#ifndef BLOCKINGQUEUE_H
+#define BLOCKINGQUEUE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+
+namespace TestTask
+{
+
+	// Unbounded hand-off queue between threads. After Close() Pop drains the remaining
+	// items and then returns false instead of blocking.
+	template <typename T>
+	class BlockingQueue
+	{
+	private:
+		std::mutex					_mutex;
+		std::condition_variable		_itemAdded;
+		std::queue<T>				_items;
+		bool						_closed = false;
+
+	public:
+		void Push(T item)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_items.push(std::move(item));
+			}
+			_itemAdded.notify_one();
+		}
+
+		bool Pop(T& item)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_itemAdded.wait(lock, [this] { return _closed || !_items.empty(); });
+
+			if (_items.empty())
+				return false;
+
+			item = std::move(_items.front());
+			_items.pop();
+			return true;
+		}
+
+		void Close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_closed = true;
+			}
+			_itemAdded.notify_all();
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef CHUNKSORTER_H
+#define CHUNKSORTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "SimdSort.h"
+#include "ThreadPool.h"
+
+namespace TestTask
+{
+
+	// Sorts in-RAM chunks. Chunks that fit into L2 cache together with their scratch buffer go
+	// through the SIMD sort kernel when the CPU has one, chunks of at least RadixSortThreshold
+	// elements through a byte-wise LSD radix sort, and small ones through std::sort. Both
+	// SIMD and radix sorts need a scratch buffer of the chunk size. With more than one thread
+	// chunks of at least ParallelSortThreshold elements are split into parts sorted in parallel
+	// and merged back along the merge path, reusing the same scratch buffer.
+	class ChunkSorter
+	{
+	public:
+		const static size_t SimdSortThreshold = 256;
+		const static size_t RadixSortThreshold = 4096;
+		const static size_t ParallelSortThreshold = 1 << 16;
+
+	private:
+		size_t					_scratchCapacity;
+		std::vector<int32_t>	_scratch;
+
+		SimdLevel				_simdLevel;
+		size_t					_simdSortLimit;
+
+		std::unique_ptr<ThreadPool>	_threadPool;
+
+	public:
+		explicit ChunkSorter(size_t scratchCapacity = 0, size_t threadsCount = 1);
+
+		// Smallest chunk worth spending RAM on a scratch buffer for
+		static size_t ScratchThreshold();
+
+		void SetScratchCapacity(size_t scratchCapacity);
+
+		size_t ScratchCapacity() const
+		{ return _scratchCapacity; }
+
+		void Sort(std::vector<int32_t>& data);
+
+	private:
+		void ReserveScratch(size_t size);
+
+		void SortRange(int32_t* data, size_t size, int32_t* scratch) const;
+		void ParallelSort(int32_t* data, size_t size, int32_t* scratch);
+
+		static size_t MergePathSplit(size_t outputSize, const int32_t* first, size_t firstSize, const int32_t* second, size_t secondSize);
+		static void RadixSort(int32_t* data, size_t size, int32_t* scratch);
+	};
+
+}
+
+#endif
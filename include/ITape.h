@@ -2,6 +2,8 @@
 #define ITAPE_H
 
 #include <cstddef>
+#include <cstdint>
+#include <string>
 
 namespace TestTask
 {
@@ -28,15 +30,29 @@ namespace TestTask
 		virtual int32_t ReadFromCurrentCell() = 0;
 		virtual void WriteToCurrentCell(int32_t data) = 0;
 
+		// Transfer count cells starting from the current one as a single pass of the head, which
+		// costs count reads or writes and one rewind. The head stops on the cell following the
+		// block in the given direction, a backward read stops on the first cell at the latest.
+		virtual void ReadBlock(int32_t* data, size_t count, Direction direction) = 0;
+		virtual void WriteBlock(const int32_t* data, size_t count) = 0;
+
 		virtual void RewindTape(size_t numberOfPositions, Direction direction) = 0;
 		virtual void RewindTape(size_t cellNumber) = 0;
 		virtual void RewindTape(Position position) = 0;
 
+		// Writes the buffered cells through to the storage, so that other heads and a later process see them
+		virtual void Flush() = 0;
+
+		// Drops the cells past the given length, the head is left on the cell following the last one at most
+		virtual void Truncate(size_t length) = 0;
+
 		virtual size_t Length() const = 0;
 
 		virtual size_t CurrentPosition() const = 0;
 
 		virtual bool EndOfTape() const = 0;
+
+		virtual const std::string& Name() const = 0;
 	};
 
 }
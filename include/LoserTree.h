@@ -0,0 +1,72 @@
+#ifndef LOSERTREE_H
+#define LOSERTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace TestTask
+{
+
+	// Tournament tree for the k-way merge. Every node stores the key of the run that lost
+	// the game in it, packed together with the run index into one word, so a replay costs
+	// exactly ceil(log2 k) comparisons of plain integers.
+	class LoserTree
+	{
+	private:
+		constexpr static uint64_t ExhaustedKey = UINT64_MAX;
+
+		size_t					_leavesCount;
+		std::vector<uint64_t>	_nodes;
+		std::vector<uint64_t>	_winners;
+
+	public:
+		LoserTree();
+
+		void Reset(size_t sourcesCount);
+
+		// RAM taken by a tree over sourcesCount runs
+		static size_t MemoryBytes(size_t sourcesCount);
+
+		void Set(size_t source, int32_t value)
+		{ _nodes[_leavesCount + source] = Pack(value, source); }
+
+		void Build();
+
+		bool Empty() const
+		{ return _nodes[0] == ExhaustedKey; }
+
+		int32_t Top() const
+		{ return static_cast<int32_t>(static_cast<uint32_t>(_nodes[0] >> 32) ^ 0x80000000u); }
+
+		size_t TopSource() const
+		{ return static_cast<uint32_t>(_nodes[0]); }
+
+		void ReplaceTop(int32_t value)
+		{
+			const size_t source = TopSource();
+			Replay(source, Pack(value, source));
+		}
+
+		void PopTop()
+		{ Replay(TopSource(), ExhaustedKey); }
+
+	private:
+		static uint64_t Pack(int32_t value, size_t source)
+		{ return (static_cast<uint64_t>(static_cast<uint32_t>(value) ^ 0x80000000u) << 32) | source; }
+
+		void Replay(size_t source, uint64_t key)
+		{
+			for (size_t node = (_leavesCount + source) >> 1; node > 0; node >>= 1)
+			{
+				if (_nodes[node] < key)
+					std::swap(_nodes[node], key);
+			}
+			_nodes[0] = key;
+		}
+	};
+
+}
+
+#endif
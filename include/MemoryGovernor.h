@@ -0,0 +1,78 @@
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <string>
+
+namespace TestTask
+{
+
+	class MemoryGovernor;
+
+
+	// Bytes taken from a MemoryGovernor, given back on destruction
+	class MemoryReservation
+	{
+	private:
+		MemoryGovernor*		_governor;
+		size_t				_bytes;
+
+	public:
+		MemoryReservation();
+		MemoryReservation(MemoryGovernor* governor, size_t bytes);
+		~MemoryReservation();
+
+		MemoryReservation(MemoryReservation&& other) noexcept;
+		MemoryReservation& operator=(MemoryReservation&& other) noexcept;
+
+		MemoryReservation(const MemoryReservation&) = delete;
+		MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+		size_t Bytes() const
+		{ return _bytes; }
+
+		void Release();
+	};
+
+
+	// Accounts the RAM of all sort data structures. A reservation over the limit throws,
+	// the highest usage seen is kept for reporting. Safe to use from several threads.
+	class MemoryGovernor
+	{
+	public:
+		constexpr static size_t Unlimited = std::numeric_limits<size_t>::max();
+
+	private:
+		mutable std::mutex	_mutex;
+		size_t				_limit;
+		size_t				_used;
+		size_t				_peak;
+
+	public:
+		explicit MemoryGovernor(size_t limit = Unlimited);
+
+		MemoryGovernor(const MemoryGovernor&) = delete;
+		MemoryGovernor& operator=(const MemoryGovernor&) = delete;
+
+		MemoryReservation Reserve(size_t bytes, const std::string& purpose);
+
+		size_t Limit() const
+		{ return _limit; }
+
+		size_t Used() const;
+		size_t Available() const;
+		size_t Peak() const;
+
+		void ResetPeak();
+
+	private:
+		friend class MemoryReservation;
+
+		void Release(size_t bytes);
+	};
+
+}
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef MERGESTREAMS_H
+#define MERGESTREAMS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <future>
+#include <limits>
+#include <vector>
+
+#include "ITape.h"
+#include "RunDirectory.h"
+#include "ThreadPool.h"
+
+namespace TestTask
+{
+
+	// Input runs of one merge, each read through its own buffer refilled by block reads.
+	// With prefetching one more buffer receives the next block of the run that will drain first,
+	// which is the run with the smallest last buffered key (Knuth's forecasting). The block is
+	// read on a thread of the given pool while the merge consumes the data already in RAM,
+	// the first one as soon as the last run is added. Without a pool the runs are not prefetched.
+	class MergeInputs
+	{
+	private:
+		struct Input
+		{
+			ITape*					tape;
+			Direction				direction;
+
+			// Cells of the run not yet requested from the tape
+			size_t					remaining;
+
+			std::vector<int32_t>	buffer;
+			size_t					bufferPos;
+		};
+
+		size_t						_blockSize;
+		size_t						_inputsCount;
+		std::vector<Input>			_inputs;
+
+		ThreadPool*					_prefetchThread;
+		std::vector<int32_t>		_prefetchBuffer;
+		size_t						_prefetchSource;
+		std::future<void>			_prefetch;
+
+	public:
+		MergeInputs(size_t inputsCount, size_t blockSize, ThreadPool* prefetchThread);
+		~MergeInputs();
+
+		MergeInputs(const MergeInputs&) = delete;
+		MergeInputs& operator=(const MergeInputs&) = delete;
+
+		// RAM of the bookkeeping of inputsCount runs, buffers aside
+		static size_t MemoryBytes(size_t inputsCount);
+
+		// Reads the first block of the run, all runs are added before the first Next
+		void Add(ITape& tape, const Run& run);
+
+		size_t Count() const
+		{ return _inputs.size(); }
+
+		bool Next(size_t source, int32_t& value)
+		{
+			Input& input = _inputs[source];
+			if (input.bufferPos == input.buffer.size() && !Refill(source))
+				return false;
+
+			value = input.buffer[input.bufferPos++];
+			return true;
+		}
+
+		// Reads a (value, count) pair of a run-length encoded run, read backward it comes as (count, value)
+		bool NextPair(size_t source, int32_t& value, size_t& count)
+		{
+			int32_t first;
+			int32_t second;
+			if (!Next(source, first) || !Next(source, second))
+				return false;
+
+			const bool backward = _inputs[source].direction == Direction::Backward;
+			value = backward ? second : first;
+			count = static_cast<uint32_t>(backward ? first : second);
+			return true;
+		}
+
+	private:
+		bool Refill(size_t source);
+		void StartPrefetch();
+
+		void ReadBlock(Input& input, std::vector<int32_t>& block);
+
+		// Cells of the next block of the run, no longer counted as remaining
+		size_t TakeBlock(Input& input) const;
+	};
+
+
+	// Writes merged elements through two buffers: one is filled while a thread of the given pool
+	// writes the other to the tape as a block. Without a pool the full buffer is written in place,
+	// a zero buffer size writes cell by cell.
+	class BlockWriter
+	{
+	private:
+		ITape*					_tape;
+		size_t					_bufferSize;
+
+		ThreadPool*				_writerThread;
+
+		std::vector<int32_t>	_buffer;
+		std::vector<int32_t>	_writeBuffer;
+		std::future<void>		_write;
+
+	public:
+		BlockWriter(ITape& tape, size_t bufferSize, ThreadPool* writerThread);
+		~BlockWriter();
+
+		BlockWriter(const BlockWriter&) = delete;
+		BlockWriter& operator=(const BlockWriter&) = delete;
+
+		void Put(int32_t value)
+		{
+			if (_bufferSize == 0)
+			{
+				_tape->WriteToCurrentCell(value);
+				_tape->RewindTape(1, Direction::Forward);
+				return;
+			}
+
+			_buffer.push_back(value);
+			if (_buffer.size() == _bufferSize)
+				Flush();
+		}
+
+		// Writes out the rest and waits for the tape, rethrows a failed write
+		void Finish();
+
+	private:
+		void Flush();
+	};
+
+
+	// Writes one run through a BlockWriter. In the run-length mode equal neighbours are stored
+	// as (value, count) pairs of cells, in the unique mode they are written once. Elements past
+	// the limit are dropped.
+	class RunWriter
+	{
+	private:
+		BlockWriter		_writer;
+		bool			_encoded;
+		bool			_unique;
+		size_t			_limit;
+
+		bool			_pending;
+		int32_t			_value;
+		size_t			_count;
+
+		// Elements put and cells written to the tape
+		size_t			_elements;
+		size_t			_length;
+
+	public:
+		RunWriter(ITape& tape, size_t bufferSize, ThreadPool* writerThread, bool encoded, bool unique, size_t limit = std::numeric_limits<size_t>::max());
+
+		void Put(int32_t value, size_t count = 1)
+		{
+			if (_unique)
+			{
+				if (_pending && value == _value)
+					return;
+
+				count = 1;
+			}
+
+			count = std::min(count, _limit - _elements);
+			if (count == 0)
+				return;
+
+			_elements += count;
+
+			if (!_encoded && !_unique)
+			{
+				_length += count;
+				for (; count != 0; --count)
+					_writer.Put(value);
+
+				return;
+			}
+
+			if (_pending && value == _value)
+			{
+				_count += count;
+				return;
+			}
+
+			if (_pending)
+				Flush();
+
+			_pending = true;
+			_value = value;
+			_count = count;
+		}
+
+		bool Full() const
+		{ return _elements == _limit; }
+
+		// Writes out the rest and returns the number of cells written
+		size_t Finish();
+
+	private:
+		void Flush();
+	};
+
+}
+
+#endif
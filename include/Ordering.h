@@ -0,0 +1,136 @@
+#ifndef ORDERING_H
+#define ORDERING_H
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ITape.h"
+
+namespace TestTask
+{
+
+	// Ordering policies map elements to keys sorted in ascending signed order. Encode must be
+	// an order-preserving bijection of int32_t and Decode its inverse, so a custom ordering is
+	// any such pair of static functions.
+	struct Ascending
+	{
+		static int32_t Encode(int32_t value)
+		{ return value; }
+
+		static int32_t Decode(int32_t key)
+		{ return key; }
+	};
+
+
+	struct Descending
+	{
+		// Bitwise negation reverses the order without overflow
+		static int32_t Encode(int32_t value)
+		{ return ~value; }
+
+		static int32_t Decode(int32_t key)
+		{ return ~key; }
+	};
+
+
+	// Compares the elements as unsigned 32-bit numbers
+	struct UnsignedAscending
+	{
+		static int32_t Encode(int32_t value)
+		{ return static_cast<int32_t>(static_cast<uint32_t>(value) ^ 0x80000000u); }
+
+		static int32_t Decode(int32_t key)
+		{ return Encode(key); }
+	};
+
+
+	enum class Ordering
+	{
+		Ascending,
+		Descending,
+		UnsignedAscending
+	};
+
+	Ordering ParseOrdering(const std::string& name);
+
+
+	// Shows the keys of Order in place of the elements of a tape: reads encode, writes decode
+	template <typename Order>
+	class OrderedTape : public ITape
+	{
+	private:
+		std::unique_ptr<ITape>	_ownedTape;
+		ITape&					_tape;
+		std::vector<int32_t>	_block;
+
+	public:
+		explicit OrderedTape(ITape& tape)
+			:	_tape(tape)
+		{ }
+
+		explicit OrderedTape(std::unique_ptr<ITape> tape)
+			:	_ownedTape(std::move(tape)),
+				_tape(*_ownedTape)
+		{ }
+
+		static std::unique_ptr<ITape> Wrap(std::unique_ptr<ITape> tape)
+		{ return std::make_unique<OrderedTape>(std::move(tape)); }
+
+		int32_t Read(size_t cellNumber) override
+		{ return Order::Encode(_tape.Read(cellNumber)); }
+
+		void Write(size_t cellNumber, int32_t data) override
+		{ _tape.Write(cellNumber, Order::Decode(data)); }
+
+		int32_t ReadFromCurrentCell() override
+		{ return Order::Encode(_tape.ReadFromCurrentCell()); }
+
+		void WriteToCurrentCell(int32_t data) override
+		{ _tape.WriteToCurrentCell(Order::Decode(data)); }
+
+		void ReadBlock(int32_t* data, size_t count, Direction direction) override
+		{
+			_tape.ReadBlock(data, count, direction);
+			std::transform(data, data + count, data, Order::Encode);
+		}
+
+		void WriteBlock(const int32_t* data, size_t count) override
+		{
+			_block.resize(count);
+			std::transform(data, data + count, _block.begin(), Order::Decode);
+			_tape.WriteBlock(_block.data(), count);
+		}
+
+		void RewindTape(size_t numberOfPositions, Direction direction) override
+		{ _tape.RewindTape(numberOfPositions, direction); }
+
+		void RewindTape(size_t cellNumber) override
+		{ _tape.RewindTape(cellNumber); }
+
+		void RewindTape(Position position) override
+		{ _tape.RewindTape(position); }
+
+		void Flush() override
+		{ _tape.Flush(); }
+
+		void Truncate(size_t length) override
+		{ _tape.Truncate(length); }
+
+		size_t Length() const override
+		{ return _tape.Length(); }
+
+		size_t CurrentPosition() const override
+		{ return _tape.CurrentPosition(); }
+
+		bool EndOfTape() const override
+		{ return _tape.EndOfTape(); }
+
+		const std::string& Name() const override
+		{ return _tape.Name(); }
+	};
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef RUNDIRECTORY_H
+#define RUNDIRECTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TestTask
+{
+
+	struct Run
+	{
+		size_t		firstCell = 0;
+		size_t		length = 0;
+
+		int32_t		minKey = 0;
+		int32_t		maxKey = 0;
+
+		// Stored in descending order, read backward from its last cell
+		bool		descending = false;
+	};
+
+
+	// Runs written to every temporary tape, in tape order. The s-th runs of all tapes form series s.
+	// The directory of a tape can be saved next to it as a text file with one run per line.
+	class RunDirectory
+	{
+	private:
+		std::vector<std::vector<Run>>	_tapeRuns;
+
+	public:
+		RunDirectory() = default;
+		explicit RunDirectory(size_t tapesCount);
+
+		static size_t MemoryBytes(size_t tapesCount, size_t runsCount)
+		{ return tapesCount * sizeof(std::vector<Run>) + runsCount * sizeof(Run); }
+
+		size_t TapesCount() const
+		{ return _tapeRuns.size(); }
+
+		// Largest number of runs on one tape
+		size_t SeriesCount() const;
+
+		// Runs on all the tapes
+		size_t RunsCount() const;
+
+		const std::vector<Run>& Runs(size_t tapeIndex) const
+		{ return _tapeRuns[tapeIndex]; }
+
+		// Adding runs to different tapes from different threads is safe
+		void Add(size_t tapeIndex, const Run& run)
+		{ _tapeRuns[tapeIndex].push_back(run); }
+
+		void Clear()
+		{ _tapeRuns.clear(); }
+
+		void Save(size_t tapeIndex, const std::string& path) const;
+		void Load(size_t tapeIndex, const std::string& path);
+	};
+
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SIMDSORT_H
+#define SIMDSORT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace TestTask
+{
+
+	enum class SimdLevel
+	{
+		Scalar,
+		Avx2,
+		Avx512
+	};
+
+	// Best instruction set supported by both the build and the running CPU
+	SimdLevel DetectSimdLevel();
+
+	// Sorting network plus bitonic merge sort. scratch must hold at least size elements.
+	void SimdSort(int32_t* data, size_t size, int32_t* scratch);
+	void SimdSort(int32_t* data, size_t size, int32_t* scratch, SimdLevel level);
+
+}
+
+#endif
@@ -2,43 +2,272 @@
 #define SORT_H
 
 #include <algorithm>
+#include <chrono>
+#include <type_traits>
+#include <typeinfo>
 #include <vector>
 
+#include "BlockingQueue.h"
+#include "ChunkSorter.h"
+#include "LoserTree.h"
+#include "MemoryGovernor.h"
+#include "Ordering.h"
+#include "RunDirectory.h"
+#include "SortCheckpoint.h"
+#include "SortPlanner.h"
+#include "SortProgress.h"
 #include "Tape.h"
+#include "ThreadPool.h"
 
 namespace TestTask
 {
 
+	struct SortOptions
+	{
+		// Limit on simultaneously open temporary tapes, 0 takes it from the process file limit
+		size_t		maxOpenTapes = 0;
+
+		// Read, sort and write chunks in parallel threads during run generation
+		bool		pipelinedSplit = false;
+
+		// Threads sorting one in-RAM chunk
+		size_t		sortThreads = 1;
+
+		// Threads generating runs from disjoint ranges of the input, each with its own read head
+		size_t		splitThreads = 1;
+
+		// Series merges of one pass that may run at the same time, each on its own set of tape heads
+		size_t		parallelTapeDrives = 1;
+
+		// Let the planner choose the fan-in instead of capping it by numberOfTemporaryTapes
+		bool		autoPlan = false;
+
+		// Tape delays the planner predicts the sort time from
+		TapeCost	tapeCost;
+
+		// Keep ascending and descending runs of the input instead of cutting it into RAM-sized chunks
+		bool		naturalRuns = false;
+
+		// Count every sort data structure against ramSize and fail instead of exceeding it
+		bool		strictMemory = false;
+
+		// Drop duplicate elements from the chunks and from every merge, as sort -u does
+		bool		unique = false;
+
+		// Store equal neighbours on the temporary tapes as (value, count) pairs, for data with few distinct values
+		bool		runLengthEncoding = false;
+
+		// Write only the first topK elements of the sorted output, 0 writes all of them
+		size_t		topK = 0;
+
+		// Save the state of an external sort next to the output tape after every run and merge pass.
+		// A checkpointed sort splits the input in one thread and without the natural runs.
+		bool		checkpoint = false;
+	};
+
+
 	class Sort
 	{
 	private:
 		using TapeFactoryPtr = std::shared_ptr<AbstractTapeFactory>;
 		using ITapeUniquePtr = std::unique_ptr<ITape>;
+		using HeadWrapper = ITapeUniquePtr (*)(ITapeUniquePtr);
+
+		// How the runs of one merge are stored on the tapes and whether their order is checked
+		struct MergeFormat
+		{
+			bool	encodedInput = false;
+			bool	encodedOutput = false;
+			bool	verifyInput = false;
+		};
 
 		TapeFactoryPtr						_tapeFactory;
+		size_t								_ramDataCapacity;
 
-		uint16_t							_numberOfTemporaryTapes;
-		uint64_t							_ramDataCapacity;
-		uint32_t							_seriesCount;
+		// Temporary tapes the runs of the current job are distributed over, chosen by its plan
+		size_t								_splitTapesCount;
+		size_t								_chunkCapacity;
+		size_t								_fanIn;
+		size_t								_maxOpenTapes;
+		bool								_pipelinedSplit;
+		bool								_naturalRuns;
+		bool								_unique;
+		bool								_runLength;
+		size_t								_outputLimit;
+		size_t								_splitThreads;
+		size_t								_parallelTapeDrives;
+		bool								_checkpointing;
 
 		std::vector<ITapeUniquePtr>			_tempTapes;
-		std::vector<ITapeUniquePtr>			_lastPhaseTapes;
+		RunDirectory						_runDirectory;
+
+		// Temporary tapes and the chunk buffer left by finished jobs, reused by the next ones
+		std::vector<ITapeUniquePtr>			_tapePool;
+		size_t								_tapePoolCapacity;
+		std::vector<int32_t>				_chunkBuffer;
+
+		// Temporary tapes are named after the output tape of the job, the engine and a serial number
+		size_t								_engineNumber;
+		size_t								_tapeSerial;
+		std::string							_tapeNamePrefix;
+
+		// Empty when the current job keeps no checkpoint
+		std::string							_checkpointPath;
+		SortCheckpoint						_checkpoint;
+
+		ChunkSorter							_chunkSorter;
+		LoserTree							_mergeTree;
+		std::unique_ptr<ThreadPool>			_mergePool;
+
+		// Writes the output and prefetches the inputs of every merge running at the same time
+		std::unique_ptr<ThreadPool>			_mergeStreamsPool;
+		std::unique_ptr<ThreadPool>			_splitPool;
+
+		SortPlanner							_planner;
+		std::shared_ptr<MemoryGovernor>		_memory;
+		std::unique_ptr<SortProgressMeter>	_progress;
+
+		// Puts the ordering of the current sort on extra heads of the input tape
+		HeadWrapper							_orderInputHead;
+		std::string							_orderName;
+
+		size_t								_outputLength;
 
 	public:
-		Sort(const TapeFactoryPtr& tapeFactory, size_t ramSize, uint16_t numberOfTemporaryTapes);
+		// One instance sorts any number of tapes one after another, every job starts from a clean state
+		Sort(const TapeFactoryPtr& tapeFactory, size_t ramSize, size_t numberOfTemporaryTapes, const SortOptions& options = SortOptions());
+
+		// Deletes the pooled temporary tapes, and those of a failed job unless its checkpoint needs them
+		~Sort();
 
-		void SortData(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape);
+		// The merge kernels sort keys of Order, the tapes are translated only at the input and the output.
+		// With resume a sort of the same input into the same output that died goes on from its checkpoint,
+		// without a checkpoint the sort starts from the beginning.
+		template <typename Order = Ascending>
+		void SortData(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape, bool resume = false);
+
+		void SortData(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape, Ordering ordering, bool resume = false);
+
+		// Merges tapes already sorted in the order Order into the output tape, through temporary tapes
+		// when there are more of them than the fan-in allows. With verifyInputs an unsorted input fails the merge.
+		template <typename Order = Ascending>
+		void MergeTapes(const std::vector<ITapeUniquePtr>& inputTapes, const ITapeUniquePtr& outputTape, bool verifyInputs = false);
+
+		void MergeTapes(const std::vector<ITapeUniquePtr>& inputTapes, const ITapeUniquePtr& outputTape, bool verifyInputs, Ordering ordering);
+
+		SortPlan Plan(size_t tapeLength) const;
+
+		// The callback hears of every phase of the following jobs and, at most once per interval,
+		// of the cells processed in between. It is called from the threads of the sort.
+		void SetProgressCallback(SortProgressCallback callback, std::chrono::milliseconds interval);
+
+		// Its peak is the one of the last job
+		const MemoryGovernor& Memory() const
+		{ return *_memory; }
+
+		// Elements written to the output tape by the last sort, fewer than the input in the unique mode
+		size_t OutputLength() const
+		{ return _outputLength; }
 
     private:
-		void SplitData(const ITapeUniquePtr& inputTape);
+		void SortKeys(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape, bool resume);
+		bool ResumeSort(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape);
+		void SelectTopK(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape);
+		void MergeKeys(const std::vector<std::string>& inputTapeNames, size_t inputLength, const ITapeUniquePtr& outputTape, bool verifyInputs);
+
+		void SplitData(const ITapeUniquePtr& inputTape, size_t firstCell = 1);
+		void SplitDataPipelined(const ITapeUniquePtr& inputTape);
+		void SplitDataParallel(const ITapeUniquePtr& inputTape);
+		void SplitDataNatural(const ITapeUniquePtr& inputTape, size_t firstCell, size_t lastCell, size_t tempTapeIndex);
+
+		size_t CopyPresortedPart(const ITapeUniquePtr& inputTape, bool& descending);
+		void SortNaturalRuns(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape);
+
+		void BeginJob(const ITapeUniquePtr& outputTape, bool checkpointed);
+
+		void DropJobTapes();
+		void CreateTemporaryTapes();
+		std::string NextTemporaryTapeName();
+		ITapeUniquePtr AcquireTemporaryTape();
+		void ReleaseTemporaryTapes(std::vector<ITapeUniquePtr>& tapes);
+		std::vector<int32_t>& ChunkBuffer(size_t capacity);
+		void WriteChunk(const std::vector<int32_t>& dataChunk, size_t& tempTapeIndex);
+		void DropDuplicates(std::vector<int32_t>& dataChunk) const;
+		void WriteRun(const std::vector<int32_t>& dataChunk, size_t tempTapeIndex);
+		void NextTemporaryTape(size_t& tempTapeIndex) const;
+		MemoryReservation ReserveSplitBuffers(size_t buffersCount);
+		void FinishSplit();
+		void SaveRunDirectory() const;
+
+		void StartCheckpoint(size_t inputLength, const SortPlan& plan);
+		void SaveCheckpoint(size_t splitPosition);
+		void SaveCheckpointRun(size_t tempTapeIndex, size_t splitPosition);
+		void FinishCheckpoint(const ITapeUniquePtr& outputTape);
 
-		void Configure(size_t tapeLength);
+		void Configure(const SortPlan& plan);
 
-		void MergeOneSeries(const ITapeUniquePtr& tape, uint32_t seriesNumber);
+		Run MergeOneSeries(std::vector<ITapeUniquePtr>& inputTapes, LoserTree& mergeTree, const ITapeUniquePtr& tape, size_t seriesNumber,
+			const SortPlanner::MergeBuffers& buffers, const MergeFormat& format) const;
 		void MergeSeries(const ITapeUniquePtr& outputTape);
-		void MergeLastSeries(const ITapeUniquePtr& outputTape);
+		void MergePass(size_t seriesCount, size_t nextTapesCount);
+		void MergePassParallel(size_t seriesCount, size_t nextTapesCount);
     };
 
+
+	template <typename Order>
+	void Sort::SortData(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape, bool resume)
+	{
+		_orderName = typeid(Order).name();
+
+		if constexpr (std::is_same_v<Order, Ascending>)
+		{
+			_orderInputHead = nullptr;
+			SortKeys(inputTape, outputTape, resume);
+		}
+		else
+		{
+			const ITapeUniquePtr orderedInput = std::make_unique<OrderedTape<Order>>(*inputTape);
+			const ITapeUniquePtr orderedOutput = std::make_unique<OrderedTape<Order>>(*outputTape);
+
+			_orderInputHead = &OrderedTape<Order>::Wrap;
+			SortKeys(orderedInput, orderedOutput, resume);
+		}
+
+		// An output tape that held more cells before keeps none of them past the sorted ones
+		outputTape->Truncate(_outputLength);
+		_progress->FinishJob();
+	}
+
+
+	template <typename Order>
+	void Sort::MergeTapes(const std::vector<ITapeUniquePtr>& inputTapes, const ITapeUniquePtr& outputTape, bool verifyInputs)
+	{
+		// Every input is read through its own head, like the ranges of the parallel split
+		std::vector<std::string> inputTapeNames;
+		size_t inputLength = 0;
+		for (const auto& tape : inputTapes)
+		{
+			inputTapeNames.push_back(tape->Name());
+			inputLength += tape->Length();
+		}
+
+		if constexpr (std::is_same_v<Order, Ascending>)
+		{
+			_orderInputHead = nullptr;
+			MergeKeys(inputTapeNames, inputLength, outputTape, verifyInputs);
+		}
+		else
+		{
+			const ITapeUniquePtr orderedOutput = std::make_unique<OrderedTape<Order>>(*outputTape);
+
+			_orderInputHead = &OrderedTape<Order>::Wrap;
+			MergeKeys(inputTapeNames, inputLength, orderedOutput, verifyInputs);
+		}
+
+		outputTape->Truncate(_outputLength);
+		_progress->FinishJob();
+	}
+
 }
 
 #endif
\ No newline at end of file
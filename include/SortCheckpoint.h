@@ -0,0 +1,56 @@
+#ifndef SORTCHECKPOINT_H
+#define SORTCHECKPOINT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "RunDirectory.h"
+
+namespace TestTask
+{
+
+	// State of an external sort saved next to its output tape after every completed run and merge
+	// pass, so that a sort that died goes on from there instead of from the beginning. The manifest
+	// is a text file, run generation appends one line per run to it instead of rewriting it.
+	struct SortCheckpoint
+	{
+		// The sort that wrote the checkpoint, a resumed one must be the same
+		std::string					order;
+		size_t						inputLength = 0;
+		bool						unique = false;
+		bool						runLengthEncoding = false;
+		size_t						outputLimit = 0;
+
+		// Plan of the run generation and the merge passes
+		size_t						chunkCapacity = 0;
+		size_t						scratchCapacity = 0;
+		size_t						fanIn = 0;
+		size_t						runsCount = 0;
+
+		// Prediction of the plan, for the progress of a resumed sort
+		size_t						mergePasses = 0;
+		double						predictedTime = 0;
+		double						predictedSplitTime = 0;
+
+		// Input cells already cut into runs, all of them once run generation is over
+		size_t						splitPosition = 0;
+
+		// Temporary tapes made after the checkpoint are numbered from here and never overwrite its tapes
+		size_t						nextTapeSerial = 0;
+
+		std::vector<std::string>	tapeNames;
+		RunDirectory				runs;
+
+		// Replaces the manifest as a whole, a crash during the save leaves the previous one
+		void Save(const std::string& path) const;
+
+		// An incomplete or garbled last line is taken for a run the crash kept from being appended
+		void Load(const std::string& path);
+
+		static void AppendRun(const std::string& path, size_t tapeIndex, const Run& run, size_t splitPosition);
+	};
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef SORTDAEMON_H
+#define SORTDAEMON_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Sort.h"
+#include "SortRequest.h"
+#include "ThreadPool.h"
+
+namespace TestTask
+{
+
+	// Serves sort and merge requests over a local UNIX socket on warm Sort engines. A request is
+	// one line with the arguments of testTask. The reply is a stream of status lines that ends
+	// with a "done" line carrying the metrics of the job or with an "error" line.
+	class SortDaemon
+	{
+	public:
+		struct Options
+		{
+			// Bytes shared by the engines, each request runs on one of them
+			size_t			ramSize = 0;
+			size_t			threads = 1;
+
+			size_t			numberOfTemporaryTapes = 0;
+			SortOptions		sortOptions;
+			Ordering		ordering = Ordering::Ascending;
+
+			// Time between the progress lines of a request, 0 sends only the plan
+			std::chrono::milliseconds	progressInterval = std::chrono::milliseconds(0);
+
+			// Time a client has to send its request, and to take each reply line before the rest of the reply is dropped
+			std::chrono::milliseconds	requestTimeout = std::chrono::seconds(5);
+			std::chrono::milliseconds	replyTimeout = std::chrono::seconds(1);
+		};
+
+	private:
+		using TapeFactoryPtr = std::shared_ptr<AbstractTapeFactory>;
+
+		TapeFactoryPtr						_tapeFactory;
+		std::string							_socketPath;
+		Ordering							_ordering;
+		std::chrono::milliseconds			_progressInterval;
+		std::chrono::milliseconds			_requestTimeout;
+		std::chrono::milliseconds			_replyTimeout;
+
+		int									_listenSocket;
+		int									_stopPipe[2];
+		std::atomic<bool>					_stopping;
+
+		std::vector<std::unique_ptr<Sort>>	_engines;
+		std::mutex							_enginesMutex;
+		std::condition_variable				_engineReleased;
+		std::vector<size_t>					_idleEngines;
+
+		std::unique_ptr<ThreadPool>			_pool;
+
+	public:
+		// Listens on socketPath, a stale socket file left by a previous daemon is replaced
+		SortDaemon(const TapeFactoryPtr& tapeFactory, const TapeFactoryPtr& temporaryTapeFactory, const std::string& socketPath, const Options& options);
+		~SortDaemon();
+
+		SortDaemon(const SortDaemon&) = delete;
+		SortDaemon& operator=(const SortDaemon&) = delete;
+
+		// Accepts requests until a shutdown request or Stop, then waits for the running ones
+		void Run();
+		void Stop();
+
+	private:
+		void Serve(int connection, const std::string& line);
+		void Execute(const SortRequest& request, Sort& engine, int connection);
+
+		size_t AcquireEngine();
+		void ReleaseEngine(size_t engineIndex);
+	};
+
+	// Sends the arguments to the daemon as one request and copies its reply to the stream,
+	// returns whether the request succeeded
+	bool SendSortRequest(const std::string& socketPath, const std::vector<std::string>& arguments, std::ostream& reply);
+
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef SORTPLANNER_H
+#define SORTPLANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace TestTask
+{
+
+	// Simulated tape delays in microseconds
+	struct TapeCost
+	{
+		size_t		readWriteDelay = 0;
+		size_t		rewindDelay = 0;
+	};
+
+
+	struct SortPlan
+	{
+		enum class Algorithm
+		{
+			InMemory,
+			ExternalMerge,
+
+			// One pass over the input keeping the smallest elements in a bounded heap
+			TopK
+		};
+
+		Algorithm	algorithm = Algorithm::InMemory;
+		bool		pipelinedSplit = false;
+
+		// Threads generating runs from disjoint ranges of the input, each with its own read head
+		size_t		splitThreads = 1;
+
+		// Elements in each run generation buffer and in the sort scratch buffer
+		size_t		chunkCapacity = 0;
+		size_t		scratchCapacity = 0;
+
+		size_t		runsCount = 0;
+		size_t		fanIn = 0;
+		size_t		mergePasses = 0;
+
+		// Elements buffered for each input run by the merges of the first pass
+		size_t		mergeBufferSize = 0;
+
+		// Microseconds of simulated tape time, of the whole sort and of reading the input into runs
+		double		predictedTime = 0;
+		double		predictedSplitTime = 0;
+	};
+
+	std::ostream& operator<<(std::ostream& stream, const SortPlan& plan);
+
+
+	// Picks the run generation buffers, fan-in and number of merge passes with the smallest
+	// predicted tape time. A plan with a single merge pass always wins when the RAM allows one.
+	class SortPlanner
+	{
+	public:
+		struct Limits
+		{
+			size_t		ramDataCapacity = 0;
+			size_t		maxFanIn = 0;
+			size_t		maxOpenTapes = 0;
+			size_t		parallelTapeDrives = 1;
+			bool		pipelinedSplit = false;
+			size_t		splitThreads = 1;
+			TapeCost	tapeCost;
+
+			// Hard limit on the bytes of all sort data structures, 0 bounds only the data buffers
+			size_t		memoryLimit = 0;
+
+			// Elements of the output selected by a heap, 0 sorts the whole input
+			size_t		topK = 0;
+		};
+
+		const static size_t PipelineBuffersCount = 3;
+
+		// Elements of one merge: a read buffer for each input run and two output buffers
+		// written in turn, no output buffers leave the output unbuffered
+		struct MergeBuffers
+		{
+			size_t		inputBufferSize = 1;
+			size_t		outputBufferSize = 0;
+
+			// One more input buffer reads ahead the run that drains first
+			bool		prefetch = false;
+		};
+
+	private:
+		Limits		_limits;
+
+	public:
+		SortPlanner() = default;
+		explicit SortPlanner(const Limits& limits);
+
+		SortPlan Plan(size_t tapeLength) const;
+
+		// Merges of one pass that can run at the same time within the limits
+		size_t ConcurrentMerges(size_t inputTapesCount, size_t outputTapesCount, size_t availableMemory) const;
+
+		// Widest merge that fits into the limits and the available memory, 0 if not even two runs fit
+		size_t MaxFanIn(size_t availableMemory) const;
+
+		// The RAM left for data is split evenly between the merges and inside a merge between its buffers
+		MergeBuffers PlanMergeBuffers(size_t inputsCount, size_t mergesCount, size_t availableMemory) const;
+
+		// RAM of one merge of inputsCount runs, besides the elements it buffers
+		static size_t MergeMemory(size_t inputsCount);
+
+		static size_t MergeBuffersMemory(size_t inputsCount, const MergeBuffers& buffers);
+
+		// RAM of the run directories of the current and the next pass
+		static size_t RunDirectoriesMemory(size_t tapesCount, size_t runsCount);
+
+	private:
+		bool Evaluate(size_t tapeLength, bool pipelinedSplit, size_t splitThreads, bool useScratch, size_t fanIn, SortPlan& plan) const;
+
+		// Tape time of one pass merging tapeLength elements, without seeking to the runs
+		double MergePassTime(size_t tapeLength, size_t mergesCount, const MergeBuffers& buffers) const;
+
+		static bool IsBetter(const SortPlan& candidate, const SortPlan& best);
+	};
+
+}
+
+#endif
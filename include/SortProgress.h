@@ -0,0 +1,128 @@
+#ifndef SORTPROGRESS_H
+#define SORTPROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <ostream>
+
+#include "SortPlanner.h"
+
+namespace TestTask
+{
+
+	struct SortProgress
+	{
+		enum class Phase
+		{
+			// Reading the input into runs, or into RAM for the in-memory and top-K sorts
+			RunGeneration,
+			Merge,
+			Done
+		};
+
+		Phase		phase = Phase::RunGeneration;
+
+		// Merge pass under way and the number of passes, the last one writes the output tape
+		size_t		pass = 0;
+		size_t		passesCount = 0;
+
+		// Input elements the phase has gone through out of all of them
+		size_t		processedCells = 0;
+		size_t		totalCells = 0;
+
+		// Microseconds of simulated tape time the plan predicts for the rest of the sort, 0 without a plan
+		double		remainingTime = 0;
+	};
+
+	std::ostream& operator<<(std::ostream& stream, const SortProgress& progress);
+
+	using SortProgressCallback = std::function<void(const SortProgress&)>;
+
+
+	// Turns the cells counted by a sort into progress reports. The callback is called at the start
+	// of every phase and at most once per interval in between, one call at a time, from whichever
+	// thread of the sort is working. Without a callback counting costs one test per batch of cells.
+	class SortProgressMeter
+	{
+	public:
+		// Hot loops count cells locally and pass them on in batches of this size
+		const static size_t BatchCells = 4096;
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		SortProgressCallback	_callback;
+		Clock::duration			_interval;
+
+		std::mutex				_mutex;
+		Clock::time_point		_lastReport;
+		SortProgress			_progress;
+		std::atomic<size_t>		_processedCells;
+
+		// Predicted tape time of the run generation and of one merge pass
+		double					_splitTime;
+		double					_passTime;
+
+	public:
+		SortProgressMeter();
+
+		SortProgressMeter(const SortProgressMeter&) = delete;
+		SortProgressMeter& operator=(const SortProgressMeter&) = delete;
+
+		// Not to be changed while a sort is running
+		void SetCallback(SortProgressCallback callback, std::chrono::milliseconds interval);
+
+		void StartJob(const SortPlan& plan, size_t inputLength);
+
+		// passesLeft counts the starting pass and the ones after it
+		void StartMergePass(size_t passesLeft);
+
+		void Advance(size_t cells)
+		{
+			if (_callback)
+				Count(cells);
+		}
+
+		void FinishJob();
+
+	private:
+		void Count(size_t cells);
+
+		// Called under the lock
+		void Report();
+	};
+
+
+	// Counter of a hot loop, it bothers the meter once per batch of cells
+	class ProgressCounter
+	{
+	private:
+		SortProgressMeter&	_meter;
+		size_t				_cells;
+
+	public:
+		explicit ProgressCounter(SortProgressMeter& meter)
+			:	_meter(meter),
+				_cells(0)
+		{ }
+
+		void Add(size_t cells = 1)
+		{
+			_cells += cells;
+			if (_cells >= SortProgressMeter::BatchCells)
+				Flush();
+		}
+
+		void Flush()
+		{
+			_meter.Advance(_cells);
+			_cells = 0;
+		}
+	};
+
+}
+
+#endif
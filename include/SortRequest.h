@@ -0,0 +1,43 @@
+#ifndef SORTREQUEST_H
+#define SORTREQUEST_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Ordering.h"
+
+namespace TestTask
+{
+
+	// Arguments of testTask, also sent by the client to the sort daemon
+	struct SortRequest
+	{
+		enum class Mode
+		{
+			Sort,
+			Merge,
+			Batch,
+			Daemon,
+			Shutdown
+		};
+
+		Mode						mode = Mode::Sort;
+		Ordering					ordering = Ordering::Ascending;
+		bool						verifyInputs = false;
+
+		// Go on with the checkpoint a sort into the same output left
+		bool						resume = false;
+
+		// The input and the output of a sort, the output and the inputs of a merge,
+		// the jobs file of a batch or the socket of the daemon
+		std::vector<std::string>	tapeNames;
+	};
+
+	SortRequest ParseSortRequest(const std::vector<std::string>& arguments, Ordering defaultOrdering);
+
+	void PrintUsage(std::ostream& stream);
+
+}
+
+#endif
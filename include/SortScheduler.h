@@ -0,0 +1,152 @@
+#ifndef SORTSCHEDULER_H
+#define SORTSCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Ordering.h"
+#include "Sort.h"
+#include "ThreadPool.h"
+
+namespace TestTask
+{
+
+	struct SortJob
+	{
+		std::string		inputTape;
+		std::string		outputTape;
+		Ordering		ordering = Ordering::Ascending;
+	};
+
+
+	struct SortJobResult
+	{
+		SortJob			job;
+		size_t			outputLength = 0;
+
+		// Seconds from the submission to the start of the sort and from the start to its end
+		double			queueSeconds = 0;
+		double			runSeconds = 0;
+
+		// Message of the exception that failed the job, empty on success
+		std::string		error;
+	};
+
+
+	struct SchedulerStats
+	{
+		size_t		submittedJobs = 0;
+		size_t		completedJobs = 0;
+		size_t		failedJobs = 0;
+		size_t		sortedElements = 0;
+
+		// Seconds since the first submission and the throughput over them
+		double		elapsedSeconds = 0;
+		double		jobsPerSecond = 0;
+		double		elementsPerSecond = 0;
+
+		// Latency of the finished jobs from the submission to the end of the sort
+		double		meanLatencySeconds = 0;
+		double		maxLatencySeconds = 0;
+		double		meanQueueSeconds = 0;
+
+		size_t		peakActiveJobs = 0;
+		size_t		peakActiveTapes = 0;
+	};
+
+
+	// Runs many sorts at once on a shared thread pool. The RAM budget is split into equal
+	// shares, one per sort engine, and every job holds the tapes it may have active at a time:
+	// the input and the output, and for an external merge the temporary tapes of one pass.
+	// Jobs are admitted in submission order as soon as an engine and enough tapes are free.
+	class SortScheduler
+	{
+	public:
+		struct Options
+		{
+			// Bytes shared by all the running sorts and the share of one sort
+			size_t			ramSize = 0;
+			size_t			jobRamSize = 0;
+
+			// Tapes that may be read or written at the same time by all the running sorts
+			size_t			maxActiveTapes = 0;
+
+			// Sorts running at the same time, also bounded by ramSize / jobRamSize
+			size_t			threads = 1;
+
+			size_t			numberOfTemporaryTapes = 0;
+			SortOptions		sortOptions;
+		};
+
+	private:
+		using Clock = std::chrono::steady_clock;
+		using TapeFactoryPtr = std::shared_ptr<AbstractTapeFactory>;
+
+		struct PendingJob
+		{
+			size_t				index;
+			SortJob				job;
+			size_t				tapesCount;
+			Clock::time_point	submitted;
+		};
+
+		TapeFactoryPtr				_tapeFactory;
+
+		size_t						_maxActiveTapes;
+		size_t						_engineOpenTapes;
+		size_t						_parallelTapeDrives;
+
+		// Sort engines are reused by the jobs one after another and stay warm between them
+		std::vector<std::unique_ptr<Sort>>	_engines;
+		std::vector<size_t>			_idleEngines;
+
+		mutable std::mutex			_mutex;
+		std::condition_variable		_jobFinished;
+		std::deque<PendingJob>		_pendingJobs;
+		std::vector<SortJobResult>	_results;
+		size_t						_activeJobs;
+		size_t						_activeTapes;
+
+		SchedulerStats				_stats;
+		Clock::time_point			_firstSubmission;
+		double						_totalLatency;
+		double						_totalQueueTime;
+
+		std::unique_ptr<ThreadPool>	_pool;
+
+	public:
+		SortScheduler(const TapeFactoryPtr& tapeFactory, const TapeFactoryPtr& temporaryTapeFactory, const Options& options);
+
+		// Waits for the submitted jobs
+		~SortScheduler();
+
+		SortScheduler(const SortScheduler&) = delete;
+		SortScheduler& operator=(const SortScheduler&) = delete;
+
+		// Queues the job and returns its index in the results
+		size_t Submit(const SortJob& job);
+
+		// Waits for all the submitted jobs, the results are in the submission order
+		std::vector<SortJobResult> Wait();
+
+		SchedulerStats Stats() const;
+
+		size_t EnginesCount() const
+		{ return _engines.size(); }
+
+	private:
+		size_t ActiveTapes(const SortPlan& plan) const;
+
+		// Starts the pending jobs that fit into the free engines and tapes, called under the lock
+		void Dispatch();
+		void Run(const PendingJob& pendingJob, size_t engineIndex);
+	};
+
+}
+
+#endif
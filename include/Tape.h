@@ -42,10 +42,16 @@ namespace TestTask
 		int32_t ReadFromCurrentCell() override;
 		void WriteToCurrentCell(int32_t data) override;
 
+		void ReadBlock(int32_t* data, size_t count, Direction direction) override;
+		void WriteBlock(const int32_t* data, size_t count) override;
+
 		void RewindTape(size_t numberOfPositions, Direction direction) override;
 		void RewindTape(size_t cellNumber) override;
 		void RewindTape(Position position) override;
 
+		void Flush() override;
+		void Truncate(size_t length) override;
+
 		size_t Length() const override
 		{ return _length; }
 
@@ -55,6 +61,9 @@ namespace TestTask
 		bool EndOfTape() const override
 		{ return _currentPos == _length; }
 
+		const std::string& Name() const override
+		{ return _tapeName; }
+
 	private:
 		Tape(const std::string& tapeName, size_t readWriteDelay, size_t rewindDelay, size_t capacity = TeraByte);
 
@@ -0,0 +1,39 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "BlockingQueue.h"
+
+namespace TestTask
+{
+
+	class ThreadPool
+	{
+	private:
+		BlockingQueue<std::function<void()>>	_tasks;
+		std::vector<std::thread>				_workers;
+
+	public:
+		explicit ThreadPool(size_t threadsCount);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		size_t Size() const
+		{ return _workers.size(); }
+
+		std::future<void> Submit(std::function<void()> task);
+
+		// Runs task(0) ... task(count - 1) on the pool and rethrows the first failure.
+		// Must not be called from a task of the same pool.
+		void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+	};
+
+}
+
+#endif
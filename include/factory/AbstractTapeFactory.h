@@ -3,6 +3,8 @@
 
 #include <memory>
 #include <optional>
+#include <stdexcept>
+#include <string>
 
 #include "ITape.h"
 
@@ -15,6 +17,21 @@ namespace TestTask
 		{ }
 
 		virtual std::unique_ptr<ITape> Create(std::string tapeName) = 0;
+
+		// Opens one more head on an existing tape, tapePath is the Name() of that tape
+		virtual std::unique_ptr<ITape> Open(const std::string& tapePath) = 0;
+
+		// Whether Create finds the tape instead of making an empty one
+		virtual bool Exists(const std::string& tapeName) const = 0;
+
+		// An input tape is never made up, a missing one is an error
+		std::unique_ptr<ITape> CreateInput(const std::string& tapeName)
+		{
+			if (!Exists(tapeName))
+				throw std::runtime_error("Input tape " + tapeName + " does not exist");
+
+			return Create(tapeName);
+		}
 	};
 
 }
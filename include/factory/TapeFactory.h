@@ -22,6 +22,8 @@ namespace TestTask
 		TapeFactory(uint32_t readWriteDelay, uint32_t rewindDelay, const std::string& pathToWorkDirectory);
 
 		std::unique_ptr<ITape> Create(std::string tapeName) override;
+		std::unique_ptr<ITape> Open(const std::string& tapePath) override;
+		bool Exists(const std::string& tapeName) const override;
 	};
 
 }
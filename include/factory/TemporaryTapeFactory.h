@@ -17,12 +17,14 @@ namespace TestTask
 
 		std::string		_pathToTempDirectory;
 
-		uint32_t		_tempTapeNumbers;
-
 	public:
 		TemporaryTapeFactory(uint32_t readWriteDelay, uint32_t rewindDelay, const std::string& pathToWorkDirectory);
 
+		// The name is kept as is, so a tape written by an earlier process is found again by it.
+		// Callers sharing the factory give every tape a name of its own.
 		std::unique_ptr<ITape> Create(std::string tapeName) override;
+		std::unique_ptr<ITape> Open(const std::string& tapePath) override;
+		bool Exists(const std::string& tapeName) const override;
 	};
 
 }
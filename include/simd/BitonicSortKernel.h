@@ -0,0 +1,183 @@
+#ifndef BITONICSORTKERNEL_H
+#define BITONICSORTKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace TestTask
+{
+
+	namespace Simd
+	{
+
+		// Vectorized merge sort of int32. Every vector is first sorted in registers by a bitonic
+		// network, then sorted runs are merged pairwise with a bitonic merge of two vectors.
+		// V describes the instruction set: Vector, Mask, Lanes, Levels (log2 of Lanes), Load, Store,
+		// Min, Max, Permute, Blend (takes the second argument where the mask is set), MakeIndex
+		// and MakeMask. It is meant to be instantiated only with types local to one translation
+		// unit, which is compiled with the matching instruction set flags.
+		template <typename V>
+		class BitonicSortKernel
+		{
+		private:
+			using Vector = typename V::Vector;
+			using Mask = typename V::Mask;
+
+			constexpr static size_t Lanes = V::Lanes;
+			constexpr static size_t Levels = V::Levels;
+
+			Vector		_exchange[Levels];
+			Mask		_cleanMasks[Levels];
+			Mask		_sortMasks[Levels * (Levels + 1) / 2];
+			Vector		_reverse;
+
+		public:
+			BitonicSortKernel()
+			{
+				int32_t index[Lanes];
+				bool flags[Lanes];
+
+				for (size_t level = 0; level < Levels; ++level)
+				{
+					const size_t distance = size_t(1) << level;
+					for (size_t lane = 0; lane < Lanes; ++lane)
+					{
+						index[lane] = static_cast<int32_t>(lane ^ distance);
+						flags[lane] = (lane & distance) != 0;
+					}
+
+					_exchange[level] = V::MakeIndex(index);
+					_cleanMasks[level] = V::MakeMask(flags);
+				}
+
+				size_t step = 0;
+				for (size_t block = 2; block <= Lanes; block <<= 1)
+				{
+					for (size_t distance = block >> 1; distance > 0; distance >>= 1)
+					{
+						for (size_t lane = 0; lane < Lanes; ++lane)
+							flags[lane] = ((lane & distance) != 0) != ((lane & block) != 0);
+
+						_sortMasks[step++] = V::MakeMask(flags);
+					}
+				}
+
+				for (size_t lane = 0; lane < Lanes; ++lane)
+					index[lane] = static_cast<int32_t>(Lanes - 1 - lane);
+				_reverse = V::MakeIndex(index);
+			}
+
+			void Sort(int32_t* data, size_t size, int32_t* scratch) const
+			{
+				for (size_t pos = 0; pos < size; pos += Lanes)
+					V::Store(data + pos, SortVector(V::Load(data + pos)));
+
+				int32_t* source = data;
+				int32_t* destination = scratch;
+
+				for (size_t runSize = Lanes; runSize < size; runSize *= 2)
+				{
+					for (size_t first = 0; first < size; first += 2 * runSize)
+					{
+						const size_t middle = first + runSize < size ? first + runSize : size;
+						const size_t last = middle + runSize < size ? middle + runSize : size;
+
+						MergeRuns(source + first, middle - first, source + middle, last - middle, destination + first);
+					}
+
+					int32_t* merged = destination;
+					destination = source;
+					source = merged;
+				}
+
+				if (source != data)
+					Copy(source, size, data);
+			}
+
+		private:
+			static void Copy(const int32_t* source, size_t size, int32_t* destination)
+			{
+				for (size_t pos = 0; pos < size; pos += Lanes)
+					V::Store(destination + pos, V::Load(source + pos));
+			}
+
+			Vector SortVector(Vector vector) const
+			{
+				size_t step = 0;
+				for (size_t blockLevel = 1; blockLevel <= Levels; ++blockLevel)
+				{
+					for (size_t level = blockLevel; level-- > 0; )
+					{
+						const Vector exchanged = V::Permute(vector, _exchange[level]);
+						vector = V::Blend(V::Min(vector, exchanged), V::Max(vector, exchanged), _sortMasks[step++]);
+					}
+				}
+				return vector;
+			}
+
+			// Sorts a bitonic vector
+			Vector CleanVector(Vector vector) const
+			{
+				for (size_t level = Levels; level-- > 0; )
+				{
+					const Vector exchanged = V::Permute(vector, _exchange[level]);
+					vector = V::Blend(V::Min(vector, exchanged), V::Max(vector, exchanged), _cleanMasks[level]);
+				}
+				return vector;
+			}
+
+			// Two sorted vectors become the sorted lower and upper halves of their union
+			void MergeVectors(Vector& low, Vector& high) const
+			{
+				const Vector reversed = V::Permute(high, _reverse);
+
+				const Vector minimums = V::Min(low, reversed);
+				const Vector maximums = V::Max(low, reversed);
+
+				low = CleanVector(minimums);
+				high = CleanVector(maximums);
+			}
+
+			void MergeRuns(const int32_t* first, size_t firstSize, const int32_t* second, size_t secondSize, int32_t* output) const
+			{
+				if (secondSize == 0)
+				{
+					Copy(first, firstSize, output);
+					return;
+				}
+
+				Vector low = V::Load(first);
+				Vector high = V::Load(second);
+				size_t firstPos = Lanes;
+				size_t secondPos = Lanes;
+
+				while (true)
+				{
+					MergeVectors(low, high);
+					V::Store(output, low);
+					output += Lanes;
+
+					// The vector with the smaller head can hold elements that precede the carried high half
+					if (firstPos < firstSize && (secondPos >= secondSize || first[firstPos] <= second[secondPos]))
+					{
+						low = V::Load(first + firstPos);
+						firstPos += Lanes;
+					}
+					else if (secondPos < secondSize)
+					{
+						low = V::Load(second + secondPos);
+						secondPos += Lanes;
+					}
+					else
+						break;
+				}
+
+				V::Store(output, high);
+			}
+		};
+
+	}
+
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SIMDSORTKERNELS_H
+#define SIMDSORTKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace TestTask
+{
+
+	namespace Simd
+	{
+		const size_t Avx2Lanes = 8;
+		const size_t Avx512Lanes = 16;
+
+		// size must be a multiple of the lane count, scratch must hold size elements
+		void SortAvx2(int32_t* data, size_t size, int32_t* scratch);
+		void SortAvx512(int32_t* data, size_t size, int32_t* scratch);
+	}
+
+}
+
+#endif
@@ -2,6 +2,9 @@
 #include <filesystem>
 
 #include "Sort.h"
+#include "SortDaemon.h"
+#include "SortRequest.h"
+#include "SortScheduler.h"
 #include "json.hpp"
 
 
@@ -13,6 +16,24 @@ namespace
 
 	const std::string RamSizeField = "ramSize";
 	const std::string NumberOfTemporaryTapes = "numberOfTemporaryTapes";
+	const std::string MaxOpenTapes = "maxOpenTapes";
+	const std::string PipelinedSplit = "pipelinedSplit";
+	const std::string SortThreads = "sortThreads";
+	const std::string SplitThreads = "splitThreads";
+	const std::string ParallelTapeDrives = "parallelTapeDrives";
+	const std::string AutoPlan = "autoPlan";
+	const std::string NaturalRuns = "naturalRuns";
+	const std::string StrictMemory = "strictMemory";
+	const std::string Order = "order";
+	const std::string Unique = "unique";
+	const std::string RunLengthEncoding = "runLengthEncoding";
+	const std::string TopK = "topK";
+	const std::string Checkpoint = "checkpoint";
+	const std::string SchedulerThreads = "schedulerThreads";
+	const std::string JobRamSize = "jobRamSize";
+	const std::string MaxActiveTapes = "maxActiveTapes";
+	const std::string DaemonThreads = "daemonThreads";
+	const std::string ProgressInterval = "progressInterval";
 
 	const std::string ReadWriteDelay = "readWriteDelay";
 	const std::string RewindDelay = "rewindDelay";
@@ -26,6 +47,7 @@ int main(int argc, char *argv[])
 	if (argc < 3)
 	{
 		std::cerr << "Path to the input and output tapes must be specified" << std::endl;
+		TestTask::PrintUsage(std::cerr);
 		return -1;
 	}
 
@@ -50,21 +72,127 @@ int main(int argc, char *argv[])
 
 		const size_t ramSize = configData.at(RamSizeField);
 
-		const uint16_t numberOfTemporaryTapes = configData.at(NumberOfTemporaryTapes);
+		const size_t numberOfTemporaryTapes = configData.at(NumberOfTemporaryTapes);
+
+		TestTask::SortOptions sortOptions;
+		sortOptions.maxOpenTapes = configData.value(MaxOpenTapes, 0);
+		sortOptions.pipelinedSplit = configData.value(PipelinedSplit, false);
+		sortOptions.sortThreads = configData.value(SortThreads, 1);
+		sortOptions.splitThreads = configData.value(SplitThreads, 1);
+		sortOptions.parallelTapeDrives = configData.value(ParallelTapeDrives, 1);
+		sortOptions.naturalRuns = configData.value(NaturalRuns, false);
+		sortOptions.strictMemory = configData.value(StrictMemory, false);
+		sortOptions.unique = configData.value(Unique, false);
+		sortOptions.runLengthEncoding = configData.value(RunLengthEncoding, false);
+		sortOptions.topK = configData.value(TopK, 0);
+		sortOptions.checkpoint = configData.value(Checkpoint, false);
 
 		const uint32_t readWriteDelay = configData.at(ReadWriteDelay);
 		const uint32_t rewindDelay = configData.at(RewindDelay);
 
+		sortOptions.autoPlan = configData.value(AutoPlan, false);
+		sortOptions.tapeCost.readWriteDelay = readWriteDelay;
+		sortOptions.tapeCost.rewindDelay = rewindDelay;
+
 		const std::string pathToWorkDirectory = configData.at(PathToWorkDirectory);
 
+		// The command line overrides the order of the configuration file
+		const TestTask::Ordering configuredOrdering = TestTask::ParseOrdering(configData.value(Order, std::string("ascending")));
+		const TestTask::SortRequest request = TestTask::ParseSortRequest(std::vector<std::string>(argv + 1, argv + argc), configuredOrdering);
+		const TestTask::Ordering ordering = request.ordering;
+		const std::vector<std::string>& tapeNames = request.tapeNames;
+
+		// Milliseconds between progress reports of a sort, 0 turns them off
+		const std::chrono::milliseconds progressInterval(configData.value(ProgressInterval, 1000));
+
 		std::shared_ptr<TestTask::AbstractTapeFactory> temporaryTapeFactory = std::make_shared<TestTask::TemporaryTapeFactory>(readWriteDelay, rewindDelay, pathToWorkDirectory);
 		std::shared_ptr<TestTask::AbstractTapeFactory> tapeFactory = std::make_shared<TestTask::TapeFactory>(readWriteDelay, rewindDelay, pathToWorkDirectory);
 
-		TestTask::Sort s(temporaryTapeFactory, ramSize, numberOfTemporaryTapes);
-		const auto inputTape = tapeFactory->Create(std::string(argv[1]));
-		const auto outputTape = tapeFactory->Create(std::string(argv[2]));
-
-		s.SortData(inputTape, outputTape);
+		if (request.mode == TestTask::SortRequest::Mode::Shutdown)
+			throw std::runtime_error("Shutdown is a request to the daemon, send it with sortClient");
+
+		if (request.mode == TestTask::SortRequest::Mode::Daemon)
+		{
+			TestTask::SortDaemon::Options daemonOptions;
+			daemonOptions.ramSize = ramSize;
+			daemonOptions.threads = configData.value(DaemonThreads, 1);
+			daemonOptions.numberOfTemporaryTapes = numberOfTemporaryTapes;
+			daemonOptions.sortOptions = sortOptions;
+			daemonOptions.ordering = ordering;
+			daemonOptions.progressInterval = progressInterval;
+
+			TestTask::SortDaemon daemon(tapeFactory, temporaryTapeFactory, tapeNames.front(), daemonOptions);
+			std::cout << "Listening on " << tapeNames.front() << std::endl;
+			daemon.Run();
+			return 0;
+		}
+
+		if (request.mode == TestTask::SortRequest::Mode::Batch)
+		{
+			// Every line of the jobs file names the input and the output tape of one sort
+			std::ifstream jobsFile(tapeNames.front());
+			if (!jobsFile.is_open())
+				throw std::runtime_error("Unable to open jobs file " + tapeNames.front());
+
+			TestTask::SortScheduler::Options schedulerOptions;
+			schedulerOptions.ramSize = ramSize;
+			schedulerOptions.threads = configData.value(SchedulerThreads, 1);
+			schedulerOptions.jobRamSize = configData.value(JobRamSize, 0);
+			schedulerOptions.maxActiveTapes = configData.value(MaxActiveTapes, schedulerOptions.threads * (2 + 2 * numberOfTemporaryTapes));
+			schedulerOptions.numberOfTemporaryTapes = numberOfTemporaryTapes;
+			schedulerOptions.sortOptions = sortOptions;
+
+			TestTask::SortScheduler scheduler(tapeFactory, temporaryTapeFactory, schedulerOptions);
+
+			TestTask::SortJob job;
+			job.ordering = ordering;
+			while (jobsFile >> job.inputTape >> job.outputTape)
+				scheduler.Submit(job);
+
+			for (const TestTask::SortJobResult& result : scheduler.Wait())
+			{
+				std::cout << result.job.inputTape << " -> " << result.job.outputTape << ": ";
+				if (result.error.empty())
+					std::cout << result.outputLength << " elements";
+				else
+					std::cout << "failed, " << result.error;
+				std::cout << ", queued " << result.queueSeconds << " s, sorted in " << result.runSeconds << " s" << std::endl;
+			}
+
+			const TestTask::SchedulerStats stats = scheduler.Stats();
+			std::cout << "Jobs: " << stats.completedJobs << " sorted, " << stats.failedJobs << " failed in " << stats.elapsedSeconds << " s" << std::endl
+				<< "Throughput: " << stats.jobsPerSecond << " jobs/s, " << stats.elementsPerSecond << " elements/s" << std::endl
+				<< "Latency: mean " << stats.meanLatencySeconds << " s, max " << stats.maxLatencySeconds << " s, mean queue time " << stats.meanQueueSeconds << " s" << std::endl
+				<< "Peak: " << stats.peakActiveJobs << " jobs, " << stats.peakActiveTapes << " active tapes" << std::endl;
+
+			return stats.failedJobs == 0 ? 0 : -1;
+		}
+
+		TestTask::Sort s(temporaryTapeFactory, ramSize, numberOfTemporaryTapes, sortOptions);
+		if (progressInterval.count() != 0)
+			s.SetProgressCallback([](const TestTask::SortProgress& progress) { std::cout << progress << std::endl; }, progressInterval);
+		if (request.mode == TestTask::SortRequest::Mode::Merge)
+		{
+			std::vector<std::unique_ptr<TestTask::ITape>> inputTapes;
+			for (size_t tapeIndex = 1; tapeIndex < tapeNames.size(); ++tapeIndex)
+				inputTapes.push_back(tapeFactory->CreateInput(tapeNames[tapeIndex]));
+
+			const auto outputTape = tapeFactory->Create(tapeNames.front());
+
+			std::cout << "Merge of " << inputTapes.size() << " sorted tapes" << std::endl;
+			s.MergeTapes(inputTapes, outputTape, request.verifyInputs, ordering);
+		}
+		else
+		{
+			const auto inputTape = tapeFactory->CreateInput(tapeNames[0]);
+			const auto outputTape = tapeFactory->Create(tapeNames[1]);
+
+			std::cout << s.Plan(inputTape->Length()) << std::endl;
+			s.SortData(inputTape, outputTape, ordering, request.resume);
+		}
+
+		std::cout << "Output length: " << s.OutputLength() << " elements" << std::endl;
+		std::cout << "Peak memory usage: " << s.Memory().Peak() << " bytes" << std::endl;
 	}
 	catch(const std::exception& e)
 	{
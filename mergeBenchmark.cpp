@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "LoserTree.h"
+
+namespace
+{
+	const size_t DefaultNumberOfElements = 1 << 22;
+	const size_t MaxFanIn = 1024;
+
+	using Runs = std::vector<std::vector<int32_t>>;
+
+	Runs GenerateRuns(size_t fanIn, size_t numberOfElements, std::mt19937& gen)
+	{
+		std::uniform_int_distribution<> dist{std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()};
+
+		Runs runs(fanIn);
+		for (size_t i = 0; i < numberOfElements; ++i)
+			runs[i % fanIn].push_back(dist(gen));
+
+		for (auto& run : runs)
+			std::sort(run.begin(), run.end());
+
+		return runs;
+	}
+
+	int64_t MergeWithHeap(const Runs& runs, std::vector<int32_t>& output)
+	{
+		std::priority_queue<std::pair<int32_t, uint16_t>, std::vector<std::pair<int32_t, uint16_t>>, std::greater<std::pair<int32_t, uint16_t>>> chunksRuns;
+		std::vector<size_t> positions(runs.size(), 1);
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (uint16_t idx = 0; idx < runs.size(); ++idx)
+			chunksRuns.push({runs[idx].front(), idx});
+
+		while (!chunksRuns.empty())
+		{
+			const auto minRun = chunksRuns.top();
+			chunksRuns.pop();
+
+			output.push_back(minRun.first);
+
+			size_t& pos = positions[minRun.second];
+			if (pos < runs[minRun.second].size())
+				chunksRuns.push({runs[minRun.second][pos++], minRun.second});
+		}
+
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	int64_t MergeWithLoserTree(const Runs& runs, std::vector<int32_t>& output)
+	{
+		TestTask::LoserTree tree;
+		std::vector<size_t> positions(runs.size(), 1);
+
+		const auto start = std::chrono::steady_clock::now();
+
+		tree.Reset(runs.size());
+		for (size_t idx = 0; idx < runs.size(); ++idx)
+			tree.Set(idx, runs[idx].front());
+		tree.Build();
+
+		while (!tree.Empty())
+		{
+			output.push_back(tree.Top());
+
+			const size_t source = tree.TopSource();
+			size_t& pos = positions[source];
+			if (pos < runs[source].size())
+				tree.ReplaceTop(runs[source][pos++]);
+			else
+				tree.PopTop();
+		}
+
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const size_t numberOfElements = argc > 1 ? std::atol(argv[1]) : DefaultNumberOfElements;
+	if (numberOfElements < MaxFanIn)
+	{
+		std::cerr << "Number of elements must be at least " << MaxFanIn << "\n";
+		return -1;
+	}
+
+	std::mt19937 gen{42};
+
+	std::vector<int32_t> heapOutput;
+	std::vector<int32_t> treeOutput;
+	heapOutput.reserve(numberOfElements);
+	treeOutput.reserve(numberOfElements);
+
+	std::cout << "fanIn\theap ns/elem\tloser tree ns/elem\n";
+	for (size_t fanIn = 2; fanIn <= MaxFanIn; fanIn *= 2)
+	{
+		const Runs runs = GenerateRuns(fanIn, numberOfElements, gen);
+
+		heapOutput.clear();
+		treeOutput.clear();
+
+		const int64_t heapTime = MergeWithHeap(runs, heapOutput);
+		const int64_t treeTime = MergeWithLoserTree(runs, treeOutput);
+
+		if (heapOutput != treeOutput)
+		{
+			std::cerr << "Merge results differ for fan-in " << fanIn << "\n";
+			return -1;
+		}
+
+		std::cout << fanIn << "\t" << static_cast<double>(heapTime) / numberOfElements
+			<< "\t" << static_cast<double>(treeTime) / numberOfElements << "\n";
+	}
+}
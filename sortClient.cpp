@@ -0,0 +1,29 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "SortDaemon.h"
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		std::cerr << "Path to the daemon socket and the request must be specified" << std::endl
+			<< "Usage: sortClient <socketPath> <testTask arguments>..." << std::endl
+			<< "       sortClient <socketPath> --shutdown" << std::endl;
+		return -1;
+	}
+
+	try
+	{
+		// The reply is printed as it comes, the last line is "done ..." or "error ..."
+		const std::vector<std::string> arguments(argv + 2, argv + argc);
+		return TestTask::SendSortRequest(argv[1], arguments, std::cout) ? 0 : -1;
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return -1;
+	}
+}
@@ -0,0 +1,205 @@
+#include "ChunkSorter.h"
+
+#include <algorithm>
+#include <array>
+
+#include <unistd.h>
+
+namespace TestTask
+{
+
+	namespace
+	{
+		const size_t RadixBits = 8;
+		const size_t RadixSize = 1 << RadixBits;
+		const size_t RadixPasses = sizeof(int32_t) * 8 / RadixBits;
+
+		// Flipping the sign bit makes the unsigned byte order match the signed order
+		uint32_t RadixKey(int32_t value)
+		{ return static_cast<uint32_t>(value) ^ 0x80000000u; }
+
+		const size_t DefaultL2CacheSize = 256 * 1024;
+
+		size_t L2CacheSize()
+		{
+			const long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+			return size > 0 ? static_cast<size_t>(size) : DefaultL2CacheSize;
+		}
+	}
+
+
+	ChunkSorter::ChunkSorter(size_t scratchCapacity, size_t threadsCount)
+		:	_scratchCapacity(scratchCapacity),
+			_simdLevel(DetectSimdLevel()),
+			_simdSortLimit(L2CacheSize() / (2 * sizeof(int32_t)))
+	{
+		if (threadsCount > 1)
+			_threadPool = std::make_unique<ThreadPool>(threadsCount);
+	}
+
+
+	size_t ChunkSorter::ScratchThreshold()
+	{ return DetectSimdLevel() != SimdLevel::Scalar ? SimdSortThreshold : RadixSortThreshold; }
+
+
+	void ChunkSorter::SetScratchCapacity(size_t scratchCapacity)
+	{
+		_scratchCapacity = scratchCapacity;
+
+		if (_scratch.size() > _scratchCapacity)
+		{
+			_scratch.clear();
+			_scratch.shrink_to_fit();
+		}
+	}
+
+
+	void ChunkSorter::Sort(std::vector<int32_t>& data)
+	{
+		const size_t size = data.size();
+
+		int32_t* scratch = nullptr;
+		if (size >= SimdSortThreshold && size <= _scratchCapacity)
+		{
+			ReserveScratch(size);
+			scratch = _scratch.data();
+		}
+
+		if (_threadPool && scratch != nullptr && size >= ParallelSortThreshold)
+			ParallelSort(data.data(), size, scratch);
+		else
+			SortRange(data.data(), size, scratch);
+	}
+
+
+	void ChunkSorter::ReserveScratch(size_t size)
+	{
+		// The buffer only grows, so consecutive chunks reuse it
+		if (_scratch.size() < size)
+			_scratch.resize(size);
+	}
+
+
+	void ChunkSorter::SortRange(int32_t* data, size_t size, int32_t* scratch) const
+	{
+		if (scratch != nullptr && _simdLevel != SimdLevel::Scalar && size >= SimdSortThreshold && size <= _simdSortLimit)
+			SimdSort(data, size, scratch, _simdLevel);
+		else if (scratch != nullptr && size >= RadixSortThreshold)
+			RadixSort(data, size, scratch);
+		else
+			std::sort(data, data + size);
+	}
+
+
+	void ChunkSorter::ParallelSort(int32_t* data, size_t size, int32_t* scratch)
+	{
+		const size_t partsCount = _threadPool->Size();
+
+		std::vector<size_t> bounds(partsCount + 1);
+		for (size_t part = 0; part <= partsCount; ++part)
+			bounds[part] = size * part / partsCount;
+
+		// Every part is sorted with its own slice of the scratch buffer
+		_threadPool->ParallelFor(partsCount, [&](size_t part)
+		{ SortRange(data + bounds[part], bounds[part + 1] - bounds[part], scratch + bounds[part]); });
+
+		int32_t* source = data;
+		int32_t* destination = scratch;
+
+		for (size_t width = 1; width < partsCount; width *= 2)
+		{
+			// Neighbouring groups of width parts are merged pairwise. The output of every merge
+			// is split at part bounds along the merge path, so that each part is produced by its own task.
+			_threadPool->ParallelFor(partsCount, [&](size_t part)
+			{
+				const size_t firstPart = part - part % (2 * width);
+				const size_t middlePart = std::min(firstPart + width, partsCount);
+				const size_t lastPart = std::min(firstPart + 2 * width, partsCount);
+
+				const int32_t* first = source + bounds[firstPart];
+				const size_t firstSize = bounds[middlePart] - bounds[firstPart];
+				const int32_t* second = source + bounds[middlePart];
+				const size_t secondSize = bounds[lastPart] - bounds[middlePart];
+
+				const size_t outputBegin = bounds[part] - bounds[firstPart];
+				const size_t outputEnd = bounds[part + 1] - bounds[firstPart];
+
+				const size_t firstBegin = MergePathSplit(outputBegin, first, firstSize, second, secondSize);
+				const size_t firstEnd = MergePathSplit(outputEnd, first, firstSize, second, secondSize);
+
+				std::merge(first + firstBegin, first + firstEnd,
+					second + (outputBegin - firstBegin), second + (outputEnd - firstEnd),
+					destination + bounds[part]);
+			});
+
+			std::swap(source, destination);
+		}
+
+		if (source != data)
+		{
+			_threadPool->ParallelFor(partsCount, [&](size_t part)
+			{ std::copy(source + bounds[part], source + bounds[part + 1], data + bounds[part]); });
+		}
+	}
+
+
+	size_t ChunkSorter::MergePathSplit(size_t outputSize, const int32_t* first, size_t firstSize, const int32_t* second, size_t secondSize)
+	{
+		// Number of elements the first outputSize elements of a stable merge take from the first run
+		size_t low = outputSize > secondSize ? outputSize - secondSize : 0;
+		size_t high = std::min(outputSize, firstSize);
+
+		while (low < high)
+		{
+			const size_t middle = low + (high - low) / 2;
+			if (first[middle] <= second[outputSize - middle - 1])
+				low = middle + 1;
+			else
+				high = middle;
+		}
+
+		return low;
+	}
+
+
+	void ChunkSorter::RadixSort(int32_t* data, size_t size, int32_t* scratch)
+	{
+		std::array<std::array<size_t, RadixSize>, RadixPasses> counts{};
+		for (size_t i = 0; i < size; ++i)
+		{
+			const uint32_t key = RadixKey(data[i]);
+			for (size_t pass = 0; pass < RadixPasses; ++pass)
+				++counts[pass][(key >> (pass * RadixBits)) & (RadixSize - 1)];
+		}
+
+		int32_t* source = data;
+		int32_t* destination = scratch;
+
+		for (size_t pass = 0; pass < RadixPasses; ++pass)
+		{
+			const size_t shift = pass * RadixBits;
+			auto& offsets = counts[pass];
+
+			// All elements share this byte, the pass would not move anything
+			if (offsets[(RadixKey(source[0]) >> shift) & (RadixSize - 1)] == size)
+				continue;
+
+			size_t offset = 0;
+			for (size_t& count : offsets)
+			{
+				const size_t bucketSize = count;
+				count = offset;
+				offset += bucketSize;
+			}
+
+			for (size_t i = 0; i < size; ++i)
+				destination[offsets[(RadixKey(source[i]) >> shift) & (RadixSize - 1)]++] = source[i];
+
+			std::swap(source, destination);
+		}
+
+		if (source != data)
+			std::copy(source, source + size, data);
+	}
+
+}
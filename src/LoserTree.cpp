@@ -0,0 +1,52 @@
+#include "LoserTree.h"
+
+#include <algorithm>
+
+namespace TestTask
+{
+
+	LoserTree::LoserTree()
+		:	_leavesCount(1),
+			_nodes(2, ExhaustedKey)
+	{ }
+
+
+	void LoserTree::Reset(size_t sourcesCount)
+	{
+		_leavesCount = 1;
+		while (_leavesCount < sourcesCount)
+			_leavesCount <<= 1;
+
+		// Leaves live right after the internal nodes so that only one flat array is touched
+		_nodes.assign(2 * _leavesCount, ExhaustedKey);
+	}
+
+
+	size_t LoserTree::MemoryBytes(size_t sourcesCount)
+	{
+		size_t leavesCount = 1;
+		while (leavesCount < sourcesCount)
+			leavesCount <<= 1;
+
+		// _nodes and _winners
+		return 2 * 2 * leavesCount * sizeof(uint64_t);
+	}
+
+
+	void LoserTree::Build()
+	{
+		_winners.assign(_nodes.begin(), _nodes.end());
+
+		for (size_t node = _leavesCount - 1; node > 0; --node)
+		{
+			const uint64_t left = _winners[2 * node];
+			const uint64_t right = _winners[2 * node + 1];
+
+			_winners[node] = std::min(left, right);
+			_nodes[node] = std::max(left, right);
+		}
+
+		_nodes[0] = _leavesCount == 1 ? _nodes[1] : _winners[1];
+	}
+
+}
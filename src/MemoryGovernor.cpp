@@ -0,0 +1,113 @@
+#include "MemoryGovernor.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace TestTask
+{
+
+	MemoryReservation::MemoryReservation()
+		:	_governor(nullptr),
+			_bytes(0)
+	{ }
+
+
+	MemoryReservation::MemoryReservation(MemoryGovernor* governor, size_t bytes)
+		:	_governor(governor),
+			_bytes(bytes)
+	{ }
+
+
+	MemoryReservation::~MemoryReservation()
+	{ Release(); }
+
+
+	MemoryReservation::MemoryReservation(MemoryReservation&& other) noexcept
+		:	_governor(other._governor),
+			_bytes(other._bytes)
+	{
+		other._governor = nullptr;
+		other._bytes = 0;
+	}
+
+
+	MemoryReservation& MemoryReservation::operator=(MemoryReservation&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Release();
+			std::swap(_governor, other._governor);
+			std::swap(_bytes, other._bytes);
+		}
+		return *this;
+	}
+
+
+	void MemoryReservation::Release()
+	{
+		if (_governor != nullptr)
+			_governor->Release(_bytes);
+
+		_governor = nullptr;
+		_bytes = 0;
+	}
+
+
+	MemoryGovernor::MemoryGovernor(size_t limit)
+		:	_limit(limit),
+			_used(0),
+			_peak(0)
+	{ }
+
+
+	MemoryReservation MemoryGovernor::Reserve(size_t bytes, const std::string& purpose)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (bytes > _limit - _used)
+		{
+			throw std::runtime_error("Memory limit of " + std::to_string(_limit) + " bytes exceeded by the " + purpose
+				+ ": " + std::to_string(bytes) + " bytes requested, " + std::to_string(_used) + " bytes in use");
+		}
+
+		_used += bytes;
+		_peak = std::max(_peak, _used);
+		return MemoryReservation(this, bytes);
+	}
+
+
+	size_t MemoryGovernor::Used() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _used;
+	}
+
+
+	size_t MemoryGovernor::Available() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _limit - _used;
+	}
+
+
+	size_t MemoryGovernor::Peak() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _peak;
+	}
+
+
+	void MemoryGovernor::ResetPeak()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_peak = _used;
+	}
+
+
+	void MemoryGovernor::Release(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_used -= bytes;
+	}
+
+}
@@ -0,0 +1,218 @@
+#include "MergeStreams.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace TestTask
+{
+
+	MergeInputs::MergeInputs(size_t inputsCount, size_t blockSize, ThreadPool* prefetchThread)
+		:	_blockSize(std::max<size_t>(blockSize, 1)),
+			_inputsCount(inputsCount),
+			_prefetchThread(prefetchThread),
+			_prefetchSource(0)
+	{
+		// Prefetch tasks refer to the inputs, which therefore never move
+		_inputs.reserve(inputsCount);
+
+		if (_prefetchThread)
+			_prefetchBuffer.reserve(_blockSize);
+	}
+
+
+	MergeInputs::~MergeInputs()
+	{
+		if (_prefetch.valid())
+			_prefetch.wait();
+	}
+
+
+	size_t MergeInputs::MemoryBytes(size_t inputsCount)
+	{ return inputsCount * sizeof(Input); }
+
+
+	void MergeInputs::Add(ITape& tape, const Run& run)
+	{
+		Input input;
+		input.tape = &tape;
+		input.direction = run.descending ? Direction::Backward : Direction::Forward;
+		input.remaining = run.length;
+		input.bufferPos = 0;
+
+		tape.RewindTape(run.descending ? run.firstCell + run.length - 1 : run.firstCell);
+		ReadBlock(input, input.buffer);
+
+		_inputs.push_back(std::move(input));
+
+		// The next block is read while the merge starts on the first ones
+		if (_inputs.size() == _inputsCount)
+			StartPrefetch();
+	}
+
+
+	bool MergeInputs::Refill(size_t source)
+	{
+		Input& input = _inputs[source];
+
+		if (_prefetch.valid() && _prefetchSource == source)
+		{
+			_prefetch.get();
+			std::swap(input.buffer, _prefetchBuffer);
+		}
+		else if (input.remaining != 0)
+			ReadBlock(input, input.buffer);
+		else
+			return false;
+
+		input.bufferPos = 0;
+
+		if (!_prefetch.valid())
+			StartPrefetch();
+
+		return true;
+	}
+
+
+	void MergeInputs::StartPrefetch()
+	{
+		if (!_prefetchThread)
+			return;
+
+		// Ties go to the lower source, as in the loser tree
+		size_t source = _inputs.size();
+		for (size_t idx = 0; idx < _inputs.size(); ++idx)
+		{
+			const Input& input = _inputs[idx];
+			if (input.remaining == 0 || input.buffer.empty())
+				continue;
+
+			if (source == _inputs.size() || input.buffer.back() < _inputs[source].buffer.back())
+				source = idx;
+		}
+
+		if (source == _inputs.size())
+			return;
+
+		Input& input = _inputs[source];
+		_prefetchBuffer.resize(TakeBlock(input));
+		_prefetchSource = source;
+
+		// Only the prefetch thread moves this head until the block is taken
+		_prefetch = _prefetchThread->Submit([this, &input]()
+		{ input.tape->ReadBlock(_prefetchBuffer.data(), _prefetchBuffer.size(), input.direction); });
+	}
+
+
+	void MergeInputs::ReadBlock(Input& input, std::vector<int32_t>& block)
+	{
+		block.resize(TakeBlock(input));
+		input.tape->ReadBlock(block.data(), block.size(), input.direction);
+	}
+
+
+	size_t MergeInputs::TakeBlock(Input& input) const
+	{
+		const size_t count = std::min(_blockSize, input.remaining);
+		input.remaining -= count;
+		return count;
+	}
+
+
+	BlockWriter::BlockWriter(ITape& tape, size_t bufferSize, ThreadPool* writerThread)
+		:	_tape(&tape),
+			_bufferSize(bufferSize),
+			_writerThread(writerThread)
+	{
+		_buffer.reserve(_bufferSize);
+
+		if (_writerThread)
+			_writeBuffer.reserve(_bufferSize);
+	}
+
+
+	BlockWriter::~BlockWriter()
+	{
+		if (_write.valid())
+			_write.wait();
+	}
+
+
+	void BlockWriter::Flush()
+	{
+		if (!_writerThread)
+		{
+			_tape->WriteBlock(_buffer.data(), _buffer.size());
+			_buffer.clear();
+			return;
+		}
+
+		// Rethrows a failed write of the previous buffer
+		if (_write.valid())
+			_write.get();
+
+		std::swap(_buffer, _writeBuffer);
+		_buffer.clear();
+
+		_write = _writerThread->Submit([this]()
+		{ _tape->WriteBlock(_writeBuffer.data(), _writeBuffer.size()); });
+	}
+
+
+	void BlockWriter::Finish()
+	{
+		if (!_buffer.empty())
+			Flush();
+
+		if (_write.valid())
+			_write.get();
+	}
+
+
+	RunWriter::RunWriter(ITape& tape, size_t bufferSize, ThreadPool* writerThread, bool encoded, bool unique, size_t limit)
+		:	_writer(tape, bufferSize, writerThread),
+			_encoded(encoded),
+			_unique(unique),
+			_limit(limit),
+			_pending(false),
+			_value(0),
+			_count(0),
+			_elements(0),
+			_length(0)
+	{ }
+
+
+	size_t RunWriter::Finish()
+	{
+		if (_pending)
+			Flush();
+
+		_pending = false;
+		_writer.Finish();
+		return _length;
+	}
+
+
+	void RunWriter::Flush()
+	{
+		if (!_encoded)
+		{
+			for (size_t idx = 0; idx < _count; ++idx)
+				_writer.Put(_value);
+
+			_length += _count;
+			return;
+		}
+
+		// A count cell holds up to 2^32 - 1 elements, longer runs of one value take several pairs
+		const size_t maxCount = std::numeric_limits<uint32_t>::max();
+		for (size_t count = _count; count != 0; )
+		{
+			const size_t pairCount = std::min(count, maxCount);
+			_writer.Put(_value);
+			_writer.Put(static_cast<int32_t>(static_cast<uint32_t>(pairCount)));
+			_length += 2;
+			count -= pairCount;
+		}
+	}
+
+}
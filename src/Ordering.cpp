@@ -0,0 +1,22 @@
+#include "Ordering.h"
+
+#include <stdexcept>
+
+namespace TestTask
+{
+
+	Ordering ParseOrdering(const std::string& name)
+	{
+		if (name == "ascending")
+			return Ordering::Ascending;
+
+		if (name == "descending")
+			return Ordering::Descending;
+
+		if (name == "unsigned")
+			return Ordering::UnsignedAscending;
+
+		throw std::runtime_error("Unknown sort order " + name);
+	}
+
+}
@@ -0,0 +1,63 @@
+#include "RunDirectory.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace TestTask
+{
+
+	RunDirectory::RunDirectory(size_t tapesCount)
+		:	_tapeRuns(tapesCount)
+	{ }
+
+
+	size_t RunDirectory::SeriesCount() const
+	{
+		size_t seriesCount = 0;
+		for (const auto& runs : _tapeRuns)
+			seriesCount = std::max(seriesCount, runs.size());
+
+		return seriesCount;
+	}
+
+
+	size_t RunDirectory::RunsCount() const
+	{
+		size_t runsCount = 0;
+		for (const auto& runs : _tapeRuns)
+			runsCount += runs.size();
+
+		return runsCount;
+	}
+
+
+	void RunDirectory::Save(size_t tapeIndex, const std::string& path) const
+	{
+		std::ofstream file(path, std::ios_base::out | std::ios_base::trunc);
+		if (!file.is_open())
+			throw std::runtime_error("Can't save the run directory " + path);
+
+		for (const Run& run : _tapeRuns[tapeIndex])
+			file << run.firstCell << ' ' << run.length << ' ' << run.minKey << ' ' << run.maxKey << ' ' << run.descending << '\n';
+	}
+
+
+	void RunDirectory::Load(size_t tapeIndex, const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+			throw std::runtime_error("Can't load the run directory " + path);
+
+		std::vector<Run> runs;
+		Run run;
+		while (file >> run.firstCell >> run.length >> run.minKey >> run.maxKey >> run.descending)
+			runs.push_back(run);
+
+		if (!file.eof())
+			throw std::runtime_error("Corrupted run directory " + path);
+
+		_tapeRuns[tapeIndex] = std::move(runs);
+	}
+
+}
@@ -0,0 +1,86 @@
+#include "SimdSort.h"
+
+#include <algorithm>
+
+#include "simd/SimdSortKernels.h"
+
+namespace TestTask
+{
+
+	SimdLevel DetectSimdLevel()
+	{
+#ifdef SIMD_SORT_X86
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx512f"))
+			return SimdLevel::Avx512;
+
+		if (__builtin_cpu_supports("avx2"))
+			return SimdLevel::Avx2;
+#endif
+		return SimdLevel::Scalar;
+	}
+
+
+	void SimdSort(int32_t* data, size_t size, int32_t* scratch)
+	{
+		static const SimdLevel level = DetectSimdLevel();
+		SimdSort(data, size, scratch, level);
+	}
+
+
+	void SimdSort(int32_t* data, size_t size, int32_t* scratch, SimdLevel level)
+	{
+		size_t lanes = 0;
+		void (*kernel)(int32_t*, size_t, int32_t*) = nullptr;
+
+#ifdef SIMD_SORT_X86
+		switch (level)
+		{
+		case SimdLevel::Avx512:
+			lanes = Simd::Avx512Lanes;
+			kernel = Simd::SortAvx512;
+			break;
+
+		case SimdLevel::Avx2:
+			lanes = Simd::Avx2Lanes;
+			kernel = Simd::SortAvx2;
+			break;
+
+		case SimdLevel::Scalar:
+			break;
+		}
+#endif
+
+		if (kernel == nullptr || size < 2 * lanes)
+		{
+			std::sort(data, data + size);
+			return;
+		}
+
+		const size_t vectorSize = size - size % lanes;
+		kernel(data, vectorSize, scratch);
+
+		if (vectorSize == size)
+			return;
+
+		// Fewer than one vector of elements is left, merge it in from the back
+		int32_t tail[Simd::Avx512Lanes];
+		const size_t tailSize = size - vectorSize;
+		std::copy(data + vectorSize, data + size, tail);
+		std::sort(tail, tail + tailSize);
+
+		size_t vectorPos = vectorSize;
+		size_t tailPos = tailSize;
+		size_t outputPos = size;
+
+		while (tailPos > 0)
+		{
+			if (vectorPos > 0 && data[vectorPos - 1] > tail[tailPos - 1])
+				data[--outputPos] = data[--vectorPos];
+			else
+				data[--outputPos] = tail[--tailPos];
+		}
+	}
+
+}
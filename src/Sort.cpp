@@ -1,6 +1,16 @@
 #include "Sort.h"
 
-#include <queue>
+#include "MergeStreams.h"
+
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+#include <sys/resource.h>
 
 namespace TestTask
 {
@@ -8,219 +18,1310 @@ namespace TestTask
 	namespace
 	{
 		const std::string TemporaryTapeName = "tmp";
+		const std::string RunDirectoryExtension = ".runs";
+		const std::string CheckpointExtension = ".checkpoint";
+
+		std::atomic<size_t> EnginesCreated(0);
+
+		// Descriptors kept aside for stdio, the input and the output tapes
+		const size_t ReservedFileDescriptors = 8;
+		const size_t MinFanIn = 2;
+
+		size_t OpenFilesLimit()
+		{
+			rlimit limit;
+			if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+				return std::numeric_limits<uint16_t>::max();
+
+			return limit.rlim_cur > ReservedFileDescriptors ? limit.rlim_cur - ReservedFileDescriptors : 0;
+		}
+
+		size_t DivideRoundingUp(size_t dividend, size_t divisor)
+		{ return dividend / divisor + (dividend % divisor != 0 ? 1 : 0); }
+
+		// Merge passes of seriesCount series including the last one that writes the output tape
+		size_t MergePassesLeft(size_t seriesCount, size_t fanIn)
+		{
+			size_t passesCount = 1;
+			for (; seriesCount > 1; ++passesCount)
+				seriesCount = DivideRoundingUp(seriesCount, std::min(fanIn, seriesCount));
+
+			return passesCount;
+		}
+
+		// Deletes a closed temporary tape together with its run directory
+		void RemoveTemporaryTape(const std::string& tapeName)
+		{
+			std::error_code error;
+			std::filesystem::remove(tapeName, error);
+			std::filesystem::remove(tapeName + RunDirectoryExtension, error);
+		}
+
+		void RemoveTemporaryTape(std::unique_ptr<ITape> tape)
+		{
+			const std::string tapeName = tape->Name();
+			tape.reset();
+			RemoveTemporaryTape(tapeName);
+		}
+
+		// FNV-1a hash of the tape name, short enough for a file name
+		std::string TapeNameKey(const std::string& tapeName)
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (const char symbol : tapeName)
+			{
+				hash ^= static_cast<uint8_t>(symbol);
+				hash *= 1099511628211ull;
+			}
+
+			std::ostringstream key;
+			key << std::hex << hash;
+			return key.str();
+		}
 	}
 
-	Sort::Sort(const TapeFactoryPtr& tapeFactory, size_t ramSize, uint16_t numberOfTemporaryTapes)
+	Sort::Sort(const TapeFactoryPtr& tapeFactory, size_t ramSize, size_t numberOfTemporaryTapes, const SortOptions& options)
 		:	_tapeFactory(tapeFactory),
 			_ramDataCapacity(ramSize / sizeof(int32_t)),
-			_numberOfTemporaryTapes(numberOfTemporaryTapes)
+			_splitTapesCount(0),
+			_pipelinedSplit(false),
+			_naturalRuns(options.naturalRuns && !options.checkpoint),
+			_unique(options.unique),
+			_runLength(options.runLengthEncoding),
+			_outputLimit(options.topK != 0 ? options.topK : std::numeric_limits<size_t>::max()),
+			_splitThreads(1),
+			_parallelTapeDrives(std::max<size_t>(options.parallelTapeDrives, 1)),
+			_checkpointing(options.checkpoint),
+			_engineNumber(EnginesCreated.fetch_add(1)),
+			_tapeSerial(0),
+			_chunkSorter(0, options.sortThreads),
+			_orderInputHead(nullptr),
+			_outputLength(0)
 	{
 		if (_ramDataCapacity == 0)
 			throw std::runtime_error("Zero RAM size");
 
-		if (_numberOfTemporaryTapes < 2)
-			_numberOfTemporaryTapes = 2;
+		_maxOpenTapes = options.maxOpenTapes;
+		if (_maxOpenTapes == 0)
+			_maxOpenTapes = OpenFilesLimit();
+
+		// Every merge pass keeps its input and output temporary tapes open at the same time,
+		// and holds one element of each merged run in RAM
+		size_t maxFanIn = std::min<size_t>(_maxOpenTapes / 2, _ramDataCapacity);
+		maxFanIn = std::min<size_t>(maxFanIn, std::numeric_limits<uint16_t>::max());
+
+		// Without the auto planner the fan-in stays within the configured number of temporary tapes
+		if (!options.autoPlan)
+			maxFanIn = std::min<size_t>(maxFanIn, numberOfTemporaryTapes);
+
+		SortPlanner::Limits limits;
+		limits.ramDataCapacity = _ramDataCapacity;
+		limits.maxFanIn = std::max(maxFanIn, MinFanIn);
+		limits.maxOpenTapes = _maxOpenTapes;
+		limits.parallelTapeDrives = _parallelTapeDrives;
+		limits.pipelinedSplit = options.pipelinedSplit;
+		// A checkpoint holds the runs of a prefix of the input. The ranges of the parallel split are not
+		// finished in input order and the natural runs split starts with a presorted part of any length,
+		// so a checkpointed sort splits in one thread.
+		limits.splitThreads = options.checkpoint ? 1 : std::max<size_t>(options.splitThreads, 1);
+		limits.tapeCost = options.tapeCost;
+		limits.memoryLimit = options.strictMemory ? ramSize : 0;
+
+		// The heap keeps equal elements, so the unique mode takes K from a sort truncated to K elements
+		limits.topK = options.unique ? 0 : options.topK;
+		_planner = SortPlanner(limits);
+
+		// A merge pass keeps the input and the output tapes, twice the fan-in, and new tapes are created
+		// only when the pool is empty, so the pool never holds more tapes open than one pass does
+		_tapePoolCapacity = 2 * limits.maxFanIn;
+		_memory = std::make_shared<MemoryGovernor>(options.strictMemory ? ramSize : MemoryGovernor::Unlimited);
+		_progress = std::make_unique<SortProgressMeter>();
+
+		if (_parallelTapeDrives > 1)
+			_mergePool = std::make_unique<ThreadPool>(_parallelTapeDrives);
+
+		// A merge has at most one block write and one prefetch pending
+		_mergeStreamsPool = std::make_unique<ThreadPool>(2 * _parallelTapeDrives);
+
+		if (limits.splitThreads > 1)
+			_splitPool = std::make_unique<ThreadPool>(limits.splitThreads);
+	}
+
+
+	Sort::~Sort()
+	{
+		DropJobTapes();
+
+		while (!_tapePool.empty())
+		{
+			RemoveTemporaryTape(std::move(_tapePool.back()));
+			_tapePool.pop_back();
+		}
 	}
 
 
-	void Sort::SortData(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape)
+	void Sort::SortData(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape, Ordering ordering, bool resume)
 	{
+		switch (ordering)
+		{
+		case Ordering::Ascending:
+			SortData<Ascending>(inputTape, outputTape, resume);
+			break;
+
+		case Ordering::Descending:
+			SortData<Descending>(inputTape, outputTape, resume);
+			break;
+
+		case Ordering::UnsignedAscending:
+			SortData<UnsignedAscending>(inputTape, outputTape, resume);
+			break;
+		}
+	}
+
+
+	void Sort::SortKeys(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape, bool resume)
+	{
+		// A resumed sort keeps checkpoints too, in case it dies again
+		BeginJob(outputTape, _checkpointing || resume);
+
+		// A checkpoint of an earlier sort is of no use to a new one
+		if (!resume && _checkpointing)
+			std::filesystem::remove(_checkpointPath);
+
 		const size_t tapeSize = inputTape->Length();
-		if (tapeSize == 0)
+		_outputLength = tapeSize;
+		if (tapeSize <= 1)
+		{
+			// Nothing to plan, the progress still has to be of this job and not of the previous one
+			_progress->StartJob(SortPlan(), tapeSize);
+			if (tapeSize == 1)
+				outputTape->WriteToCurrentCell(inputTape->ReadFromCurrentCell());
+
 			return;
+		}
 
-		if (tapeSize == 1)
+		if (resume && ResumeSort(inputTape, outputTape))
+			return;
+
+		const SortPlan plan = Plan(tapeSize);
+		Configure(plan);
+		_progress->StartJob(plan, tapeSize);
+
+		if (plan.algorithm == SortPlan::Algorithm::TopK)
 		{
-			outputTape->WriteToCurrentCell(inputTape->ReadFromCurrentCell());
+			SelectTopK(inputTape, outputTape);
 			return;
 		}
 
-		if (tapeSize <= _ramDataCapacity)
+		if (plan.algorithm == SortPlan::Algorithm::InMemory)
 		{
-			std::vector<int32_t> dataChunk;
-			dataChunk.reserve(_ramDataCapacity);
-			for (int pos = 0; pos < tapeSize; ++pos)
+			const MemoryReservation chunkMemory = _memory->Reserve((tapeSize + plan.scratchCapacity) * sizeof(int32_t), "in-memory sort buffers");
+
+			std::vector<int32_t>& dataChunk = ChunkBuffer(tapeSize);
+			ProgressCounter progress(*_progress);
+			for (size_t pos = 0; pos < tapeSize; ++pos)
+			{
 				dataChunk.push_back(inputTape->Read(pos + 1));
+				progress.Add();
+			}
+			progress.Flush();
 
-			std::sort(dataChunk.begin(), dataChunk.end());
+			_chunkSorter.Sort(dataChunk);
+			DropDuplicates(dataChunk);
+			_outputLength = std::min(dataChunk.size(), _outputLimit);
 
-			for (size_t i = 0; i < tapeSize; ++i)
+			for (size_t i = 0; i < _outputLength; ++i)
 			{
 				outputTape->WriteToCurrentCell(dataChunk.at(i));
 				outputTape->RewindTape(1, Direction::Forward);
 			}
+
 			return;
 		}
 
-		Configure(tapeSize);
+		const MemoryReservation directoryMemory = _memory->Reserve(SortPlanner::RunDirectoriesMemory(_splitTapesCount, plan.runsCount), "run directories");
+		StartCheckpoint(tapeSize, plan);
+
+		// A resumed sort keeps a checkpoint even without the option, see the constructor
+		const bool checkpointed = !_checkpointPath.empty();
+		if (_naturalRuns && !checkpointed)
+		{
+			SortNaturalRuns(inputTape, outputTape);
+			return;
+		}
+
+		if (_splitThreads > 1 && !checkpointed)
+			SplitDataParallel(inputTape);
+		else if (_pipelinedSplit)
+			SplitDataPipelined(inputTape);
+		else
+			SplitData(inputTape);
 
-		SplitData(inputTape);
 		MergeSeries(outputTape);
-		MergeLastSeries(outputTape);
 	}
 
 
-	void Sort::Configure(size_t tapeLength)
+	bool Sort::ResumeSort(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape)
 	{
-		size_t totalNumberOfChunks = tapeLength / _ramDataCapacity;
-		if (tapeLength % _ramDataCapacity != 0)
-			totalNumberOfChunks += 1;
+		if (!std::filesystem::exists(_checkpointPath))
+			return false;
+
+		SortCheckpoint checkpoint;
+		checkpoint.Load(_checkpointPath);
+
+		if (checkpoint.order != _orderName || checkpoint.inputLength != inputTape->Length() || checkpoint.unique != _unique
+			|| checkpoint.runLengthEncoding != _runLength || checkpoint.outputLimit != _outputLimit)
+			throw std::runtime_error("Checkpoint " + _checkpointPath + " was saved by another sort");
+
+		// The runs are cut as the checkpoint planned them, a split that was cut short goes on sequentially
+		SortPlan plan;
+		plan.algorithm = SortPlan::Algorithm::ExternalMerge;
+		plan.chunkCapacity = checkpoint.chunkCapacity;
+		plan.scratchCapacity = checkpoint.scratchCapacity;
+		plan.fanIn = checkpoint.fanIn;
+		plan.runsCount = checkpoint.runsCount;
+		plan.mergePasses = checkpoint.mergePasses;
+		plan.predictedTime = checkpoint.predictedTime;
+		plan.predictedSplitTime = checkpoint.predictedSplitTime;
+		Configure(plan);
+
+		const bool splitFinished = checkpoint.splitPosition >= checkpoint.inputLength;
+		if (!splitFinished && checkpoint.tapeNames.size() != _splitTapesCount)
+			throw std::runtime_error("Corrupted checkpoint " + _checkpointPath);
+
+		for (size_t tapeIndex = 0; tapeIndex < checkpoint.tapeNames.size(); ++tapeIndex)
+		{
+			const std::string& tapeName = checkpoint.tapeNames[tapeIndex];
+			if (!std::filesystem::exists(tapeName))
+				throw std::runtime_error("Temporary tape " + tapeName + " of the checkpoint " + _checkpointPath + " is missing");
+
+			ITapeUniquePtr tape = _tapeFactory->Open(tapeName);
+
+			const std::vector<Run>& runs = checkpoint.runs.Runs(tapeIndex);
+			const size_t runsEnd = runs.empty() ? 1 : runs.back().firstCell + runs.back().length;
+			if (tape->Length() + 1 < runsEnd)
+				throw std::runtime_error("Temporary tape " + tapeName + " is shorter than its runs in the checkpoint " + _checkpointPath);
+
+			// Run generation goes on past the last run of the tape
+			tape->RewindTape(runsEnd);
+			_tempTapes.push_back(std::move(tape));
+		}
+
+		_runDirectory = checkpoint.runs;
+		_tapeSerial = std::max(_tapeSerial, checkpoint.nextTapeSerial);
+		_checkpoint = std::move(checkpoint);
+
+		const MemoryReservation directoryMemory = _memory->Reserve(SortPlanner::RunDirectoriesMemory(_splitTapesCount, plan.runsCount), "run directories");
+
+		_progress->StartJob(plan, _checkpoint.inputLength);
+		if (!splitFinished)
+		{
+			// The runs are appended after whole lines, the rewrite drops a line the crash cut short
+			SaveCheckpoint(_checkpoint.splitPosition);
+
+			_progress->Advance(_checkpoint.splitPosition);
+			SplitData(inputTape, _checkpoint.splitPosition + 1);
+		}
+
+		MergeSeries(outputTape);
+		return true;
+	}
+
+
+	void Sort::MergeTapes(const std::vector<ITapeUniquePtr>& inputTapes, const ITapeUniquePtr& outputTape, bool verifyInputs, Ordering ordering)
+	{
+		switch (ordering)
+		{
+		case Ordering::Ascending:
+			MergeTapes<Ascending>(inputTapes, outputTape, verifyInputs);
+			break;
+
+		case Ordering::Descending:
+			MergeTapes<Descending>(inputTapes, outputTape, verifyInputs);
+			break;
+
+		case Ordering::UnsignedAscending:
+			MergeTapes<UnsignedAscending>(inputTapes, outputTape, verifyInputs);
+			break;
+		}
+	}
+
+
+	void Sort::SetProgressCallback(SortProgressCallback callback, std::chrono::milliseconds interval)
+	{ _progress->SetCallback(std::move(callback), interval); }
+
+
+	void Sort::MergeKeys(const std::vector<std::string>& inputTapeNames, size_t inputLength, const ITapeUniquePtr& outputTape, bool verifyInputs)
+	{
+		BeginJob(outputTape, false);
+
+		// A merge has no chunks to sort, the buffers kept warm by earlier sorts give their memory to it
+		_chunkBuffer = std::vector<int32_t>();
+		_chunkSorter.SetScratchCapacity(0);
+
+		const size_t fanIn = _planner.MaxFanIn(_memory->Available());
+		if (fanIn == 0)
+			throw std::runtime_error("RAM size is too small for any merge");
+
+		// The inputs are merged in groups of fanIn tapes, each group makes one run of the first pass
+		const size_t groupsCount = DivideRoundingUp(inputTapeNames.size(), fanIn);
+		const size_t nextTapesCount = std::min(fanIn, groupsCount);
+
+		// A merge has no run generation, the groups are merged by its first pass
+		SortPlan plan;
+		plan.mergePasses = groupsCount > 1 ? 1 + MergePassesLeft(DivideRoundingUp(groupsCount, nextTapesCount), fanIn) : 1;
+		_progress->StartJob(plan, inputLength);
+		_progress->StartMergePass(plan.mergePasses);
+
+		std::vector<ITapeUniquePtr> nextTapes;
+		if (groupsCount > 1)
+		{
+			for (size_t tapeIndex = 0; tapeIndex < nextTapesCount; ++tapeIndex)
+				nextTapes.push_back(AcquireTemporaryTape());
+		}
+
+		// The heads of the input tapes take the place of pooled tapes in the open tape limit
+		const size_t openTapesCount = nextTapes.size() + std::min(fanIn, inputTapeNames.size());
+		const size_t pooledTapesCount = _tapePoolCapacity - std::min(_tapePoolCapacity, openTapesCount);
+		while (_tapePool.size() > pooledTapesCount)
+		{
+			RemoveTemporaryTape(std::move(_tapePool.back()));
+			_tapePool.pop_back();
+		}
+
+		RunDirectory nextRunDirectory(nextTapesCount);
+
+		for (size_t group = 0; group < groupsCount; ++group)
+		{
+			// Every input tape is one run, empty ones take no part
+			std::vector<ITapeUniquePtr> inputHeads;
+			std::vector<Run> inputRuns;
+			for (size_t idx = group * fanIn; idx < std::min((group + 1) * fanIn, inputTapeNames.size()); ++idx)
+			{
+				ITapeUniquePtr inputHead = _tapeFactory->Open(inputTapeNames[idx]);
+				if (_orderInputHead)
+					inputHead = _orderInputHead(std::move(inputHead));
+
+				const size_t length = inputHead->Length();
+				if (length == 0)
+					continue;
 
-		if (totalNumberOfChunks < _numberOfTemporaryTapes)
-			_numberOfTemporaryTapes = totalNumberOfChunks;
+				inputRuns.push_back({1, length, inputHead->Read(1), inputHead->Read(length)});
+				inputHeads.push_back(std::move(inputHead));
+			}
+
+			_runDirectory = RunDirectory(inputHeads.size());
+			for (size_t idx = 0; idx < inputRuns.size(); ++idx)
+				_runDirectory.Add(idx, inputRuns[idx]);
 
-		const uint16_t totalNumberOfChunksOfOneSeries = _ramDataCapacity * _numberOfTemporaryTapes;
-		if (totalNumberOfChunksOfOneSeries > tapeLength)
-			_seriesCount = 1;
+			const SortPlanner::MergeBuffers buffers = _planner.PlanMergeBuffers(inputHeads.size(), 1, _memory->Available());
+			if (groupsCount == 1)
+			{
+				if (!inputHeads.empty())
+					_outputLength = MergeOneSeries(inputHeads, _mergeTree, outputTape, 0, buffers, {false, false, verifyInputs}).length;
 
+				_runDirectory.Clear();
+				return;
+			}
+
+			if (!inputHeads.empty())
+			{
+				const size_t tapeIndex = group % nextTapesCount;
+				nextRunDirectory.Add(tapeIndex, MergeOneSeries(inputHeads, _mergeTree, nextTapes[tapeIndex], 0, buffers, {false, _runLength, verifyInputs}));
+			}
+		}
+
+		_fanIn = fanIn;
+		_tempTapes = std::move(nextTapes);
+		_runDirectory = std::move(nextRunDirectory);
+		SaveRunDirectory();
+
+		if (_runDirectory.SeriesCount() != 0)
+			MergeSeries(outputTape);
 		else
+			ReleaseTemporaryTapes(_tempTapes);
+	}
+
+
+	void Sort::SelectTopK(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape)
+	{
+		const MemoryReservation heapMemory = _memory->Reserve(_outputLimit * sizeof(int32_t), "top-K heap");
+
+		// Max-heap of the smallest elements read so far, its top is the first to give way
+		std::vector<int32_t>& heap = ChunkBuffer(_outputLimit);
+		ProgressCounter progress(*_progress);
+
+		const size_t tapeSize = inputTape->Length();
+		for (size_t pos = 1; pos <= tapeSize; ++pos)
+		{
+			const int32_t value = inputTape->Read(pos);
+			progress.Add();
+
+			if (heap.size() < _outputLimit)
+			{
+				heap.push_back(value);
+				std::push_heap(heap.begin(), heap.end());
+			}
+			else if (value < heap.front())
+			{
+				std::pop_heap(heap.begin(), heap.end());
+				heap.back() = value;
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+
+		progress.Flush();
+
+		std::sort_heap(heap.begin(), heap.end());
+		for (const int32_t value : heap)
 		{
-			_seriesCount = tapeLength / totalNumberOfChunksOfOneSeries;
-			if (tapeLength % totalNumberOfChunksOfOneSeries != 0)
-				_seriesCount += 1;
+			outputTape->WriteToCurrentCell(value);
+			outputTape->RewindTape(1, Direction::Forward);
 		}
+
+		_outputLength = heap.size();
 	}
 
 
-	void Sort::SplitData(const ITapeUniquePtr& inputTape)
+	SortPlan Sort::Plan(size_t tapeLength) const
+	{ return _planner.Plan(tapeLength); }
+
+
+	void Sort::Configure(const SortPlan& plan)
 	{
-		for (uint16_t tempTapeIndex = 0; tempTapeIndex < _numberOfTemporaryTapes; tempTapeIndex++)
-			_tempTapes.push_back(_tapeFactory->Create(TemporaryTapeName));
+		_chunkCapacity = plan.chunkCapacity;
+		_chunkSorter.SetScratchCapacity(plan.scratchCapacity);
+		_pipelinedSplit = plan.pipelinedSplit;
+		_splitThreads = plan.splitThreads;
 
-		std::vector<int32_t> dataChunk;
-		dataChunk.reserve(_ramDataCapacity);
+		_fanIn = plan.fanIn;
+		_splitTapesCount = std::min(plan.fanIn, plan.runsCount);
 
-		uint16_t tempTapeIndex = 0;
-		uint64_t elementPos = 0;
+		// The chunk buffer of the previous job stays only if this one uses it within its planned memory
+		const bool usesChunkBuffer = plan.algorithm != SortPlan::Algorithm::ExternalMerge || (!plan.pipelinedSplit && plan.splitThreads == 1);
+		if (!usesChunkBuffer || _chunkBuffer.capacity() > plan.chunkCapacity)
+			_chunkBuffer = std::vector<int32_t>();
+	}
+
+
+	void Sort::SplitData(const ITapeUniquePtr& inputTape, size_t firstCell)
+	{
+		// A resumed split goes on with the tapes and runs of the checkpoint
+		if (_tempTapes.empty())
+			CreateTemporaryTapes();
 
-		for(size_t pos = 1; pos <= inputTape->Length(); ++pos)
+		const MemoryReservation buffersMemory = ReserveSplitBuffers(1);
+
+		std::vector<int32_t>& dataChunk = ChunkBuffer(_chunkCapacity);
+
+		size_t tempTapeIndex = _runDirectory.RunsCount() % _splitTapesCount;
+		size_t elementPos = 0;
+
+		for(size_t pos = firstCell; pos <= inputTape->Length(); ++pos)
 		{
 			dataChunk.push_back(inputTape->Read(pos));
 
 			++elementPos;
-			if (elementPos >= _ramDataCapacity || inputTape->EndOfTape())
+			if (elementPos >= _chunkCapacity || inputTape->EndOfTape())
 			{
-				const size_t chunkSize = dataChunk.size();
 				elementPos = 0;
 
-				if (chunkSize != 1)
-					std::sort(dataChunk.begin(), dataChunk.end());
+				_progress->Advance(dataChunk.size());
+				if (dataChunk.size() != 1)
+					_chunkSorter.Sort(dataChunk);
+
+				DropDuplicates(dataChunk);
+
+				const size_t runTapeIndex = tempTapeIndex;
+				WriteChunk(dataChunk, tempTapeIndex);
+				SaveCheckpointRun(runTapeIndex, pos);
+				dataChunk.clear();
+			}
+		}
+
+		FinishSplit();
+	}
+
+
+	void Sort::SplitDataPipelined(const ITapeUniquePtr& inputTape)
+	{
+		CreateTemporaryTapes();
+		const MemoryReservation buffersMemory = ReserveSplitBuffers(SortPlanner::PipelineBuffersCount);
 
-				for (size_t i = 0; i < chunkSize; ++i)
+		// Chunks circulate between the reading, sorting and writing stages, so at most
+		// SortPlanner::PipelineBuffersCount of them are alive at any time
+		BlockingQueue<std::vector<int32_t>> freeChunks;
+		BlockingQueue<std::vector<int32_t>> filledChunks;
+		BlockingQueue<std::vector<int32_t>> sortedChunks;
+
+		for (size_t bufferIndex = 0; bufferIndex < SortPlanner::PipelineBuffersCount; ++bufferIndex)
+		{
+			std::vector<int32_t> dataChunk;
+			dataChunk.reserve(_chunkCapacity);
+			freeChunks.Push(std::move(dataChunk));
+		}
+
+		const size_t tapeLength = inputTape->Length();
+
+		std::exception_ptr readError;
+		std::thread reader([&]()
+		{
+			try
+			{
+				size_t pos = 1;
+
+				std::vector<int32_t> dataChunk;
+				while (pos <= tapeLength && freeChunks.Pop(dataChunk))
 				{
-					_tempTapes[tempTapeIndex]->WriteToCurrentCell(dataChunk.at(i));
-					_tempTapes[tempTapeIndex]->RewindTape(1, Direction::Forward);
+					dataChunk.clear();
+					for (; pos <= tapeLength && dataChunk.size() < _chunkCapacity; ++pos)
+						dataChunk.push_back(inputTape->Read(pos));
+
+					_progress->Advance(dataChunk.size());
+					filledChunks.Push(std::move(dataChunk));
 				}
+			}
+			catch (...)
+			{
+				readError = std::current_exception();
+			}
+			filledChunks.Close();
+		});
 
-				++tempTapeIndex;
-				if (tempTapeIndex >= _numberOfTemporaryTapes)
-					tempTapeIndex = 0;
+		std::exception_ptr sortError;
+		std::thread sorter([&]()
+		{
+			try
+			{
+				std::vector<int32_t> dataChunk;
+				while (filledChunks.Pop(dataChunk))
+				{
+					_chunkSorter.Sort(dataChunk);
+					DropDuplicates(dataChunk);
+					sortedChunks.Push(std::move(dataChunk));
+				}
+			}
+			catch (...)
+			{
+				sortError = std::current_exception();
+			}
+			sortedChunks.Close();
+		});
+
+		std::exception_ptr writeError;
+		try
+		{
+			size_t tempTapeIndex = 0;
+			size_t splitPosition = 0;
+
+			std::vector<int32_t> dataChunk;
+			while (sortedChunks.Pop(dataChunk))
+			{
+				// Every chunk but the last one is read whole, so the chunk ends where the next one would start
+				splitPosition = std::min(splitPosition + _chunkCapacity, tapeLength);
+
+				const size_t runTapeIndex = tempTapeIndex;
+				WriteChunk(dataChunk, tempTapeIndex);
+				SaveCheckpointRun(runTapeIndex, splitPosition);
+				freeChunks.Push(std::move(dataChunk));
+			}
+		}
+		catch (...)
+		{
+			writeError = std::current_exception();
+		}
+		freeChunks.Close();
+
+		reader.join();
+		sorter.join();
+
+		for (const auto& error : {readError, sortError, writeError})
+		{
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		FinishSplit();
+	}
+
+
+	void Sort::SplitDataParallel(const ITapeUniquePtr& inputTape)
+	{
+		CreateTemporaryTapes();
+		const MemoryReservation buffersMemory = ReserveSplitBuffers(_splitThreads);
+
+		// Ranges of the input are whole numbers of chunks, so the runs come out as in the sequential split
+		const size_t tapeLength = inputTape->Length();
+		const size_t chunksCount = tapeLength / _chunkCapacity + (tapeLength % _chunkCapacity != 0 ? 1 : 0);
+		const size_t scratchCapacity = _chunkSorter.ScratchCapacity() / _splitThreads;
+		const std::string inputTapeName = inputTape->Name();
+
+		// Thread i reads its range with its own head and writes temporary tapes i, i + _splitThreads, ...
+		_splitPool->ParallelFor(_splitThreads, [&](size_t threadIndex)
+		{
+			ITapeUniquePtr inputHead = _tapeFactory->Open(inputTapeName);
+			if (_orderInputHead)
+				inputHead = _orderInputHead(std::move(inputHead));
+
+			ChunkSorter chunkSorter(scratchCapacity);
+
+			const size_t firstChunk = chunksCount * threadIndex / _splitThreads;
+			const size_t lastChunk = chunksCount * (threadIndex + 1) / _splitThreads;
+
+			std::vector<int32_t> dataChunk;
+			dataChunk.reserve(_chunkCapacity);
+
+			size_t tempTapeIndex = threadIndex;
+			for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+			{
+				const size_t firstCell = chunk * _chunkCapacity + 1;
+				const size_t lastCell = std::min(firstCell + _chunkCapacity - 1, tapeLength);
 
 				dataChunk.clear();
+				for (size_t pos = firstCell; pos <= lastCell; ++pos)
+					dataChunk.push_back(inputHead->Read(pos));
+
+				_progress->Advance(dataChunk.size());
+				chunkSorter.Sort(dataChunk);
+				DropDuplicates(dataChunk);
+				WriteRun(dataChunk, tempTapeIndex);
+
+				tempTapeIndex += _splitThreads;
+				if (tempTapeIndex >= _splitTapesCount)
+					tempTapeIndex = threadIndex;
 			}
+		});
+
+		FinishSplit();
+	}
+
+
+	void Sort::SortNaturalRuns(const ITapeUniquePtr& inputTape, const ITapeUniquePtr& outputTape)
+	{
+		const size_t tapeSize = inputTape->Length();
+		CreateTemporaryTapes();
+
+		// The presorted part is the first run, a sorted input is the only one and the final merge copies it to the output
+		bool descending = false;
+		const size_t copiedCount = CopyPresortedPart(inputTape, descending);
+
+		if (descending)
+			SplitDataNatural(inputTape, 1, tapeSize - copiedCount, 1);
+		else
+			SplitDataNatural(inputTape, copiedCount + 1, tapeSize, 1);
+
+		MergeSeries(outputTape);
+	}
+
+
+	size_t Sort::CopyPresortedPart(const ITapeUniquePtr& inputTape, bool& descending)
+	{
+		// Copies the input to the first temporary tape while it stays sorted. A first element greater than
+		// the last one suggests reverse-sorted input, which is then read backward from its end.
+		// Returns the number of input elements consumed.
+		const size_t tapeSize = inputTape->Length();
+		descending = inputTape->Read(1) > inputTape->Read(tapeSize);
+
+		const Direction direction = descending ? Direction::Backward : Direction::Forward;
+		inputTape->RewindTape(descending ? tapeSize : 1);
+
+		Run copiedRun{_tempTapes[0]->CurrentPosition()};
+		RunWriter writer(*_tempTapes[0], 0, nullptr, _runLength, _unique, _outputLimit);
+
+		size_t copiedCount = 0;
+		int32_t lastValue = 0;
+		ProgressCounter progress(*_progress);
+		while (copiedCount < tapeSize)
+		{
+			if (copiedCount > 0)
+				inputTape->RewindTape(1, direction);
+
+			const int32_t value = inputTape->ReadFromCurrentCell();
+			if (copiedCount > 0 && value < lastValue)
+				break;
+
+			if (!writer.Full())
+			{
+				if (copiedCount == 0)
+					copiedRun.minKey = value;
+				copiedRun.maxKey = value;
+
+				writer.Put(value);
+			}
+
+			lastValue = value;
+			++copiedCount;
+			progress.Add();
 		}
 
-		for(size_t tapeIndex = 0; tapeIndex < _numberOfTemporaryTapes; ++tapeIndex)
-			_tempTapes[tapeIndex]->RewindTape(Position::Begin);
+		copiedRun.length = writer.Finish();
+		_runDirectory.Add(0, copiedRun);
+
+		progress.Flush();
+		return copiedCount;
 	}
 
 
-	void Sort::MergeOneSeries(const ITapeUniquePtr& tape, uint32_t seriesNumber)
+	void Sort::SplitDataNatural(const ITapeUniquePtr& inputTape, size_t firstCell, size_t lastCell, size_t tempTapeIndex)
 	{
-		std::vector<uint32_t> seriesElementsNumber(_numberOfTemporaryTapes, _ramDataCapacity);
+		const MemoryReservation buffersMemory = ReserveSplitBuffers(1);
+
+		std::vector<int32_t>& dataChunk = ChunkBuffer(_chunkCapacity);
 
-		std::priority_queue<std::pair<int32_t, uint16_t>, std::vector<std::pair<int32_t, uint16_t>>, std::greater<std::pair<int32_t, uint16_t>>> chunksRuns;
+		// Element read past the end of the previous run, it opens the next chunk
+		std::optional<int32_t> carriedValue;
 
-		const size_t tempTapePosition = seriesNumber * _ramDataCapacity + 1;
-		for(uint16_t tempTapeIdx = 0; tempTapeIdx < _numberOfTemporaryTapes; ++tempTapeIdx)
+		size_t pos = firstCell;
+		size_t countedPos = firstCell;
+		while (pos <= lastCell || carriedValue)
 		{
-			const size_t tapeLength = _tempTapes[tempTapeIdx]->Length();
+			_progress->Advance(pos - countedPos);
+			countedPos = pos;
+
+			dataChunk.clear();
+			if (carriedValue)
+			{
+				dataChunk.push_back(*carriedValue);
+				carriedValue.reset();
+			}
+
+			for (; pos <= lastCell && dataChunk.size() < _chunkCapacity; ++pos)
+				dataChunk.push_back(inputTape->Read(pos));
+
+			const bool ascending = std::is_sorted(dataChunk.begin(), dataChunk.end());
+			const bool descending = !ascending && std::is_sorted(dataChunk.rbegin(), dataChunk.rend());
 
-			if (tapeLength == 0)
+			if (!ascending && !descending)
+			{
+				_chunkSorter.Sort(dataChunk);
+				DropDuplicates(dataChunk);
+				WriteChunk(dataChunk, tempTapeIndex);
 				continue;
+			}
 
-			else if (tapeLength == 1)
-				chunksRuns.push({_tempTapes[tempTapeIdx]->ReadFromCurrentCell(), tempTapeIdx});
+			// A monotone chunk is a natural run, which may go on past the chunk
+			bool runContinues = false;
+			if (pos <= lastCell)
+			{
+				carriedValue = inputTape->Read(pos++);
+				runContinues = descending ? *carriedValue <= dataChunk.back() : *carriedValue >= dataChunk.back();
+			}
 
-			if (!_tempTapes[tempTapeIdx]->EndOfTape())
+			if (!runContinues)
 			{
-				_tempTapes[tempTapeIdx]->RewindTape(tempTapePosition);
-				chunksRuns.push({_tempTapes[tempTapeIdx]->ReadFromCurrentCell(), tempTapeIdx});
+				if (descending)
+					std::reverse(dataChunk.begin(), dataChunk.end());
 
-				seriesElementsNumber.at(tempTapeIdx) -= 1;
+				DropDuplicates(dataChunk);
+				WriteChunk(dataChunk, tempTapeIndex);
+				continue;
 			}
+
+			// The run does not fit into RAM, so it is streamed to the tape in input order
+			// and a descending one is read backward by the merge. The smallest elements of
+			// a descending run come last, so the output limit cuts only ascending runs.
+			const ITapeUniquePtr& tape = _tempTapes[tempTapeIndex];
+			Run run;
+			run.firstCell = tape->CurrentPosition();
+			run.descending = descending;
+			run.minKey = std::numeric_limits<int32_t>::max();
+			run.maxKey = std::numeric_limits<int32_t>::min();
+
+			RunWriter writer(*tape, 0, nullptr, _runLength, _unique, descending ? std::numeric_limits<size_t>::max() : _outputLimit);
+			const auto put = [&](int32_t value)
+			{
+				if (writer.Full())
+					return;
+
+				writer.Put(value);
+				run.minKey = std::min(run.minKey, value);
+				run.maxKey = std::max(run.maxKey, value);
+			};
+
+			for (const int32_t value : dataChunk)
+				put(value);
+
+			int32_t lastValue = dataChunk.back();
+			while (carriedValue)
+			{
+				const int32_t value = *carriedValue;
+				if (descending ? value > lastValue : value < lastValue)
+					break;
+
+				put(value);
+				lastValue = value;
+
+				carriedValue.reset();
+				if (pos <= lastCell)
+					carriedValue = inputTape->Read(pos++);
+
+				if (pos - countedPos >= SortProgressMeter::BatchCells)
+				{
+					_progress->Advance(pos - countedPos);
+					countedPos = pos;
+				}
+			}
+
+			run.length = writer.Finish();
+			_runDirectory.Add(tempTapeIndex, run);
+			NextTemporaryTape(tempTapeIndex);
 		}
 
-		while (!chunksRuns.empty())
+		_progress->Advance(pos - countedPos);
+		FinishSplit();
+	}
+
+
+	void Sort::BeginJob(const ITapeUniquePtr& outputTape, bool checkpointed)
+	{
+		DropJobTapes();
+		_runDirectory.Clear();
+		_outputLength = 0;
+		_memory->ResetPeak();
+
+		// Other sorts sharing the temporary directory, this one resumed by another process included,
+		// write into tapes of other names
+		_tapeNamePrefix = TemporaryTapeName + TapeNameKey(outputTape->Name()) + "_" + std::to_string(_engineNumber) + "_";
+		_checkpointPath = checkpointed ? outputTape->Name() + CheckpointExtension : std::string();
+	}
+
+
+	void Sort::DropJobTapes()
+	{
+		// Tapes left by a failed job may be in any state, so they are not pooled, and only its checkpoint needs them
+		if (_checkpointPath.empty())
 		{
-			const auto minRun = chunksRuns.top();
-			chunksRuns.pop();
+			for (auto& tape : _tempTapes)
+				RemoveTemporaryTape(std::move(tape));
+		}
+
+		_tempTapes.clear();
+	}
 
-			tape->WriteToCurrentCell(minRun.first);
-			tape->RewindTape(1, Direction::Forward);
-			const uint16_t minElemTapeIdx = minRun.second;
 
-			if (!_tempTapes.at(minElemTapeIdx)->EndOfTape() && seriesElementsNumber.at(minElemTapeIdx) > 0)
-			{
-				_tempTapes.at(minElemTapeIdx)->RewindTape(1, Direction::Forward);
-				chunksRuns.push({_tempTapes.at(minElemTapeIdx)->ReadFromCurrentCell(), minElemTapeIdx});
+	void Sort::CreateTemporaryTapes()
+	{
+		for (size_t tempTapeIndex = 0; tempTapeIndex < _splitTapesCount; tempTapeIndex++)
+			_tempTapes.push_back(AcquireTemporaryTape());
+
+		_runDirectory = RunDirectory(_splitTapesCount);
+		SaveCheckpoint(0);
+	}
+
+
+	std::string Sort::NextTemporaryTapeName()
+	{ return _tapeNamePrefix + std::to_string(_tapeSerial++); }
 
-				seriesElementsNumber.at(minElemTapeIdx) -= 1;
+
+	Sort::ITapeUniquePtr Sort::AcquireTemporaryTape()
+	{
+		if (_tapePool.empty())
+			return _tapeFactory->Create(NextTemporaryTapeName());
+
+		// Runs are found through the run directory, so old data past them is never read
+		ITapeUniquePtr tape = std::move(_tapePool.back());
+		_tapePool.pop_back();
+		tape->RewindTape(Position::Begin);
+		return tape;
+	}
+
+
+	void Sort::ReleaseTemporaryTapes(std::vector<ITapeUniquePtr>& tapes)
+	{
+		for (auto& tape : tapes)
+		{
+			if (_tapePool.size() >= _tapePoolCapacity)
+			{
+				RemoveTemporaryTape(std::move(tape));
+				continue;
 			}
+
+			// The runs of a pooled tape are over, its data is overwritten by the next job
+			std::error_code error;
+			std::filesystem::remove(tape->Name() + RunDirectoryExtension, error);
+			_tapePool.push_back(std::move(tape));
 		}
 
+		tapes.clear();
 	}
 
 
-	void Sort::MergeSeries(const ITapeUniquePtr& outputTape)
+	std::vector<int32_t>& Sort::ChunkBuffer(size_t capacity)
 	{
-		uint32_t seriesNumber = 0;
+		_chunkBuffer.clear();
+		_chunkBuffer.reserve(capacity);
+		return _chunkBuffer;
+	}
 
-		if (_seriesCount == 1)
+
+	MemoryReservation Sort::ReserveSplitBuffers(size_t buffersCount)
+	{ return _memory->Reserve((buffersCount * _chunkCapacity + _chunkSorter.ScratchCapacity()) * sizeof(int32_t), "run generation buffers"); }
+
+
+	void Sort::FinishSplit()
+	{
+		// The chunk and scratch buffers go back before the merge takes their memory
+		_chunkBuffer = std::vector<int32_t>();
+		_chunkSorter.SetScratchCapacity(0);
+
+		for(size_t tapeIndex = 0; tapeIndex < _splitTapesCount; ++tapeIndex)
+			_tempTapes[tapeIndex]->RewindTape(Position::Begin);
+
+		SaveRunDirectory();
+		SaveCheckpoint(_checkpoint.inputLength);
+	}
+
+
+	void Sort::SaveRunDirectory() const
+	{
+		for (size_t tapeIndex = 0; tapeIndex < _tempTapes.size(); ++tapeIndex)
+			_runDirectory.Save(tapeIndex, _tempTapes[tapeIndex]->Name() + RunDirectoryExtension);
+	}
+
+
+	void Sort::StartCheckpoint(size_t inputLength, const SortPlan& plan)
+	{
+		_checkpoint = SortCheckpoint();
+		_checkpoint.order = _orderName;
+		_checkpoint.inputLength = inputLength;
+		_checkpoint.unique = _unique;
+		_checkpoint.runLengthEncoding = _runLength;
+		_checkpoint.outputLimit = _outputLimit;
+
+		_checkpoint.chunkCapacity = plan.chunkCapacity;
+		_checkpoint.scratchCapacity = plan.scratchCapacity;
+		_checkpoint.fanIn = plan.fanIn;
+		_checkpoint.runsCount = plan.runsCount;
+		_checkpoint.mergePasses = plan.mergePasses;
+		_checkpoint.predictedTime = plan.predictedTime;
+		_checkpoint.predictedSplitTime = plan.predictedSplitTime;
+	}
+
+
+	void Sort::SaveCheckpoint(size_t splitPosition)
+	{
+		if (_checkpointPath.empty())
+			return;
+
+		// The tapes reach the disk before the manifest that points to them
+		_checkpoint.tapeNames.clear();
+		for (const auto& tape : _tempTapes)
 		{
-			MergeOneSeries(outputTape, seriesNumber);
+			tape->Flush();
+			_checkpoint.tapeNames.push_back(tape->Name());
+		}
+
+		_checkpoint.splitPosition = splitPosition;
+		_checkpoint.nextTapeSerial = _tapeSerial;
+		_checkpoint.runs = _runDirectory;
+		_checkpoint.Save(_checkpointPath);
+	}
+
+
+	void Sort::SaveCheckpointRun(size_t tempTapeIndex, size_t splitPosition)
+	{
+		if (_checkpointPath.empty())
+			return;
+
+		_tempTapes[tempTapeIndex]->Flush();
+		SortCheckpoint::AppendRun(_checkpointPath, tempTapeIndex, _runDirectory.Runs(tempTapeIndex).back(), splitPosition);
+	}
+
+
+	void Sort::FinishCheckpoint(const ITapeUniquePtr& outputTape)
+	{
+		if (_checkpointPath.empty())
 			return;
+
+		outputTape->Flush();
+		std::filesystem::remove(_checkpointPath);
+	}
+
+
+	void Sort::WriteChunk(const std::vector<int32_t>& dataChunk, size_t& tempTapeIndex)
+	{
+		WriteRun(dataChunk, tempTapeIndex);
+		NextTemporaryTape(tempTapeIndex);
+	}
+
+
+	void Sort::DropDuplicates(std::vector<int32_t>& dataChunk) const
+	{
+		if (_unique)
+			dataChunk.erase(std::unique(dataChunk.begin(), dataChunk.end()), dataChunk.end());
+	}
+
+
+	void Sort::WriteRun(const std::vector<int32_t>& dataChunk, size_t tempTapeIndex)
+	{
+		Run run{_tempTapes[tempTapeIndex]->CurrentPosition(), 0, dataChunk.front(), dataChunk.back()};
+
+		RunWriter writer(*_tempTapes[tempTapeIndex], 0, nullptr, _runLength, _unique, _outputLimit);
+		for (const int32_t value : dataChunk)
+			writer.Put(value);
+
+		run.length = writer.Finish();
+		_runDirectory.Add(tempTapeIndex, run);
+	}
+
+
+	void Sort::NextTemporaryTape(size_t& tempTapeIndex) const
+	{
+		++tempTapeIndex;
+		if (tempTapeIndex >= _splitTapesCount)
+			tempTapeIndex = 0;
+	}
+
+
+	Run Sort::MergeOneSeries(std::vector<ITapeUniquePtr>& inputTapes, LoserTree& mergeTree, const ITapeUniquePtr& tape, size_t seriesNumber, const SortPlanner::MergeBuffers& buffers,
+		const MergeFormat& format) const
+	{
+		const MemoryReservation mergeMemory = _memory->Reserve(SortPlanner::MergeMemory(inputTapes.size())
+			+ SortPlanner::MergeBuffersMemory(inputTapes.size(), buffers), "merge tree and buffers");
+
+		std::vector<size_t> seriesTapes;
+		for (size_t tempTapeIdx = 0; tempTapeIdx < inputTapes.size(); ++tempTapeIdx)
+		{
+			if (seriesNumber < _runDirectory.Runs(tempTapeIdx).size())
+				seriesTapes.push_back(tempTapeIdx);
+		}
+
+		const auto seriesRun = [&](size_t tempTapeIdx) -> const Run&
+		{ return _runDirectory.Runs(tempTapeIdx)[seriesNumber]; };
+
+		std::sort(seriesTapes.begin(), seriesTapes.end(), [&](size_t first, size_t second)
+		{ return seriesRun(first).minKey < seriesRun(second).minKey; });
+
+		Run mergedRun;
+		mergedRun.firstCell = tape->CurrentPosition();
+
+		bool disjointRuns = true;
+		MergeInputs inputs(seriesTapes.size(), buffers.inputBufferSize, buffers.prefetch ? _mergeStreamsPool.get() : nullptr);
+
+		for (size_t idx = 0; idx < seriesTapes.size(); ++idx)
+		{
+			const Run& run = seriesRun(seriesTapes[idx]);
+			inputs.Add(*inputTapes[seriesTapes[idx]], run);
+
+			mergedRun.minKey = idx == 0 ? run.minKey : std::min(mergedRun.minKey, run.minKey);
+			mergedRun.maxKey = idx == 0 ? run.maxKey : std::max(mergedRun.maxKey, run.maxKey);
+
+			if (idx > 0 && seriesRun(seriesTapes[idx - 1]).maxKey > run.minKey)
+				disjointRuns = false;
+		}
+
+		// Counts of the current elements of the run-length encoded runs, equal keys of different runs add up
+		std::vector<size_t> counts(inputs.Count(), 1);
+		std::vector<int32_t> lastValues(format.verifyInput ? inputs.Count() : 0, std::numeric_limits<int32_t>::min());
+
+		const auto next = [&](size_t source, int32_t& element)
+		{
+			if (!(format.encodedInput ? inputs.NextPair(source, element, counts[source]) : inputs.Next(source, element)))
+				return false;
+
+			if (format.verifyInput)
+			{
+				if (element < lastValues[source])
+					throw std::runtime_error("Input tape " + inputTapes[seriesTapes[source]]->Name() + " is not sorted");
+
+				lastValues[source] = element;
+			}
+
+			return true;
+		};
+
+		// No merge needs more than the elements of the output
+		RunWriter writer(*tape, buffers.outputBufferSize, _mergeStreamsPool.get(), format.encodedOutput, _unique, _outputLimit);
+		ProgressCounter progress(*_progress);
+		int32_t value = 0;
+
+		// Runs with disjoint key ranges are copied one after another in key order
+		if (disjointRuns)
+		{
+			for (size_t source = 0; source < inputs.Count() && !writer.Full(); ++source)
+			{
+				while (!writer.Full() && next(source, value))
+				{
+					writer.Put(value, counts[source]);
+					progress.Add(counts[source]);
+				}
+			}
+
+			progress.Flush();
+			mergedRun.length = writer.Finish();
+			return mergedRun;
+		}
+
+		mergeTree.Reset(inputs.Count());
+		for (size_t source = 0; source < inputs.Count(); ++source)
+		{
+			if (next(source, value))
+				mergeTree.Set(source, value);
 		}
+		mergeTree.Build();
 
-		while (_seriesCount)
+		while (!mergeTree.Empty() && !writer.Full())
 		{
-			_lastPhaseTapes.push_back(_tapeFactory->Create(TemporaryTapeName));
-			MergeOneSeries(_lastPhaseTapes.at(seriesNumber), seriesNumber);
+			const size_t source = mergeTree.TopSource();
+			writer.Put(mergeTree.Top(), counts[source]);
+			progress.Add(counts[source]);
 
-			--_seriesCount;
-			++seriesNumber;
+			if (next(source, value))
+				mergeTree.ReplaceTop(value);
+			else
+				mergeTree.PopTop();
 		}
+
+		progress.Flush();
+		mergedRun.length = writer.Finish();
+		return mergedRun;
 	}
 
 
-	void Sort::MergeLastSeries(const ITapeUniquePtr& outputTape)
+	void Sort::MergeSeries(const ITapeUniquePtr& outputTape)
 	{
-		std::priority_queue<std::pair<int32_t, uint16_t>, std::vector<std::pair<int32_t, uint16_t>>, std::greater<std::pair<int32_t, uint16_t>>> chunksRuns;
+		size_t seriesCount = _runDirectory.SeriesCount();
 
-		for(uint16_t idx = 0; idx < _lastPhaseTapes.size(); ++idx)
+		while (seriesCount > 1)
 		{
-			if (!_lastPhaseTapes[idx]->EndOfTape())
+			_progress->StartMergePass(MergePassesLeft(seriesCount, _fanIn));
+			const size_t nextTapesCount = std::min<size_t>(_fanIn, seriesCount);
+
+			if (_mergePool)
+				MergePassParallel(seriesCount, nextTapesCount);
+			else
+				MergePass(seriesCount, nextTapesCount);
+
+			seriesCount = _runDirectory.SeriesCount();
+		}
+
+		_progress->StartMergePass(1);
+		const SortPlanner::MergeBuffers buffers = _planner.PlanMergeBuffers(_tempTapes.size(), 1, _memory->Available());
+		_outputLength = MergeOneSeries(_tempTapes, _mergeTree, outputTape, 0, buffers, {_runLength, false}).length;
+		FinishCheckpoint(outputTape);
+
+		ReleaseTemporaryTapes(_tempTapes);
+		_runDirectory.Clear();
+	}
+
+
+	void Sort::MergePass(size_t seriesCount, size_t nextTapesCount)
+	{
+		RunDirectory nextRunDirectory(nextTapesCount);
+		const SortPlanner::MergeBuffers buffers = _planner.PlanMergeBuffers(_tempTapes.size(), 1, _memory->Available());
+
+		// The inputs of the pass stay until the checkpoint no longer needs them
+		std::vector<ITapeUniquePtr> nextTapes;
+		std::vector<ITapeUniquePtr> passInputTapes;
+		try
+		{
+			for (size_t tapeIndex = 0; tapeIndex < nextTapesCount; ++tapeIndex)
+				nextTapes.push_back(AcquireTemporaryTape());
+
+			for (size_t seriesNumber = 0; seriesNumber < seriesCount; ++seriesNumber)
 			{
-				_lastPhaseTapes[idx]->RewindTape(Position::Begin);
-				chunksRuns.push({_lastPhaseTapes[idx]->ReadFromCurrentCell(), idx});
+				const size_t tapeIndex = seriesNumber % nextTapesCount;
+				nextRunDirectory.Add(tapeIndex, MergeOneSeries(_tempTapes, _mergeTree, nextTapes[tapeIndex], seriesNumber, buffers, {_runLength, _runLength}));
 			}
+
+			passInputTapes = std::move(_tempTapes);
+			_tempTapes = std::move(nextTapes);
+			_runDirectory = std::move(nextRunDirectory);
+			SaveRunDirectory();
+			SaveCheckpoint(_checkpoint.inputLength);
 		}
+		catch (...)
+		{
+			// A failed pass leaves the job with its inputs, the checkpoint still points to them
+			if (!passInputTapes.empty())
+			{
+				nextTapes = std::move(_tempTapes);
+				_tempTapes = std::move(passInputTapes);
+			}
 
-		while (!chunksRuns.empty())
+			for (auto& tape : nextTapes)
+				RemoveTemporaryTape(std::move(tape));
+			throw;
+		}
+
+		ReleaseTemporaryTapes(passInputTapes);
+	}
+
+
+	void Sort::MergePassParallel(size_t seriesCount, size_t nextTapesCount)
+	{
+		const size_t inputTapesCount = _tempTapes.size();
+
+		const size_t mergesCount = _planner.ConcurrentMerges(inputTapesCount, nextTapesCount, _memory->Available());
+		if (mergesCount <= 1)
 		{
-			const auto minRun = chunksRuns.top();
-			chunksRuns.pop();
+			MergePass(seriesCount, nextTapesCount);
+			return;
+		}
 
-			outputTape->WriteToCurrentCell(minRun.first);
-			outputTape->RewindTape(1, Direction::Forward);
-			const uint16_t minElemTapeIdx = minRun.second;
+		// Closing the tapes flushes them, so that the new heads see all the written data. The pooled
+		// tapes are closed too, the open tape limit of the concurrent merges has no room for them.
+		std::vector<std::string> inputTapeNames;
+		for (const auto& tape : _tempTapes)
+			inputTapeNames.push_back(tape->Name());
+		_tempTapes.clear();
+
+		for (auto& tape : _tapePool)
+			RemoveTemporaryTape(std::move(tape));
+		_tapePool.clear();
+
+		const SortPlanner::MergeBuffers buffers = _planner.PlanMergeBuffers(inputTapesCount, mergesCount, _memory->Available());
+		RunDirectory nextRunDirectory(nextTapesCount);
+
+		std::vector<std::string> nextTapeNames;
+		for (size_t tapeIndex = 0; tapeIndex < nextTapesCount; ++tapeIndex)
+			nextTapeNames.push_back(NextTemporaryTapeName());
 
-			if (!_lastPhaseTapes.at(minElemTapeIdx)->EndOfTape())
+		try
+		{
+			// Output tape i receives series i, i + nextTapesCount, ... and is written by one merge only
+			_mergePool->ParallelFor(mergesCount, [&](size_t mergeIndex)
 			{
-				_lastPhaseTapes.at(minElemTapeIdx)->RewindTape(1, Direction::Forward);
-				chunksRuns.push({_lastPhaseTapes.at(minElemTapeIdx)->ReadFromCurrentCell(), minElemTapeIdx});
+				std::vector<ITapeUniquePtr> inputTapes;
+				for (const auto& tapeName : inputTapeNames)
+					inputTapes.push_back(_tapeFactory->Open(tapeName));
+
+				LoserTree mergeTree;
+
+				for (size_t tapeIndex = mergeIndex; tapeIndex < nextTapesCount; tapeIndex += mergesCount)
+				{
+					const auto tape = _tapeFactory->Create(nextTapeNames[tapeIndex]);
+					nextTapeNames[tapeIndex] = tape->Name();
+
+					for (size_t seriesNumber = tapeIndex; seriesNumber < seriesCount; seriesNumber += nextTapesCount)
+						nextRunDirectory.Add(tapeIndex, MergeOneSeries(inputTapes, mergeTree, tape, seriesNumber, buffers, {_runLength, _runLength}));
+				}
+			});
+
+			for (const auto& tapeName : nextTapeNames)
+				_tempTapes.push_back(_tapeFactory->Open(tapeName));
+
+			_runDirectory = std::move(nextRunDirectory);
+			SaveRunDirectory();
+			SaveCheckpoint(_checkpoint.inputLength);
+		}
+		catch (...)
+		{
+			// The job no longer holds the tapes of the pass, so they are removed here unless the checkpoint needs the inputs
+			_tempTapes.clear();
+			for (const auto& tapeName : nextTapeNames)
+				RemoveTemporaryTape(tapeName);
+
+			if (_checkpointPath.empty())
+			{
+				for (const auto& tapeName : inputTapeNames)
+					RemoveTemporaryTape(tapeName);
 			}
+			throw;
 		}
+
+		for (const auto& tapeName : inputTapeNames)
+			RemoveTemporaryTape(tapeName);
 	}
 
 }
\ No newline at end of file
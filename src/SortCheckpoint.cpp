@@ -0,0 +1,148 @@
+#include "SortCheckpoint.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace TestTask
+{
+
+	namespace
+	{
+		const std::string SortField = "sort";
+		const std::string PlanField = "plan";
+		const std::string SerialField = "serial";
+		const std::string SplitField = "split";
+		const std::string TapeField = "tape";
+		const std::string RunField = "run";
+
+		const std::string PartialExtension = ".part";
+
+		void WriteRun(std::ostream& stream, size_t tapeIndex, const Run& run, size_t splitPosition)
+		{
+			stream << RunField << ' ' << tapeIndex << ' ' << run.firstCell << ' ' << run.length << ' '
+				<< run.minKey << ' ' << run.maxKey << ' ' << run.descending << ' ' << splitPosition << '\n';
+		}
+	}
+
+	void SortCheckpoint::Save(const std::string& path) const
+	{
+		const std::string partialPath = path + PartialExtension;
+		{
+			std::ofstream file(partialPath, std::ios_base::out | std::ios_base::trunc);
+			if (!file.is_open())
+				throw std::runtime_error("Can't save the checkpoint " + path);
+
+			file << SortField << ' ' << order << ' ' << inputLength << ' ' << unique << ' ' << runLengthEncoding << ' ' << outputLimit << '\n'
+				<< PlanField << ' ' << chunkCapacity << ' ' << scratchCapacity << ' ' << fanIn << ' ' << runsCount
+					<< ' ' << mergePasses << ' ' << predictedTime << ' ' << predictedSplitTime << '\n'
+				<< SerialField << ' ' << nextTapeSerial << '\n'
+				<< SplitField << ' ' << splitPosition << '\n';
+
+			for (const std::string& tapeName : tapeNames)
+				file << TapeField << ' ' << tapeName << '\n';
+
+			for (size_t tapeIndex = 0; tapeIndex < runs.TapesCount(); ++tapeIndex)
+			{
+				for (const Run& run : runs.Runs(tapeIndex))
+					WriteRun(file, tapeIndex, run, splitPosition);
+			}
+
+			if (!file.flush())
+				throw std::runtime_error("Can't save the checkpoint " + path);
+		}
+
+		std::filesystem::rename(partialPath, path);
+	}
+
+
+	void SortCheckpoint::Load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+			throw std::runtime_error("Can't load the checkpoint " + path);
+
+		*this = SortCheckpoint();
+
+		bool hasHeader = false;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			// A line without its end was being appended when the sort died, its run was never saved
+			if (file.eof())
+				break;
+
+			std::istringstream lineStream(line);
+			std::string field;
+			lineStream >> field;
+
+			bool valid = true;
+			if (field == SortField)
+			{
+				valid = static_cast<bool>(lineStream >> order >> inputLength >> unique >> runLengthEncoding >> outputLimit);
+				hasHeader = true;
+			}
+			else if (field == PlanField)
+			{
+				valid = static_cast<bool>(lineStream >> chunkCapacity >> scratchCapacity >> fanIn >> runsCount
+					>> mergePasses >> predictedTime >> predictedSplitTime);
+			}
+			else if (field == SerialField)
+				valid = static_cast<bool>(lineStream >> nextTapeSerial);
+			else if (field == SplitField)
+				valid = static_cast<bool>(lineStream >> splitPosition);
+			else if (field == TapeField && runs.TapesCount() == 0)
+			{
+				// The name is the rest of the line
+				tapeNames.push_back(line.substr(TapeField.size() + 1));
+			}
+			else if (field == RunField && !tapeNames.empty())
+			{
+				if (runs.TapesCount() == 0)
+					runs = RunDirectory(tapeNames.size());
+
+				size_t tapeIndex;
+				size_t runSplitPosition;
+				Run run;
+				valid = static_cast<bool>(lineStream >> tapeIndex >> run.firstCell >> run.length >> run.minKey >> run.maxKey >> run.descending >> runSplitPosition)
+					&& tapeIndex < tapeNames.size();
+
+				if (valid)
+				{
+					runs.Add(tapeIndex, run);
+					splitPosition = std::max(splitPosition, runSplitPosition);
+				}
+			}
+			else
+				valid = false;
+
+			// So was a garbled last line, one in the middle is not the trace of a crash
+			if (!valid && file.peek() == std::ifstream::traits_type::eof())
+				break;
+
+			if (!valid)
+				throw std::runtime_error("Corrupted checkpoint " + path);
+		}
+
+		if (!hasHeader || tapeNames.empty())
+			throw std::runtime_error("Corrupted checkpoint " + path);
+
+		if (runs.TapesCount() == 0)
+			runs = RunDirectory(tapeNames.size());
+	}
+
+
+	void SortCheckpoint::AppendRun(const std::string& path, size_t tapeIndex, const Run& run, size_t splitPosition)
+	{
+		std::ofstream file(path, std::ios_base::out | std::ios_base::app);
+		if (!file.is_open())
+			throw std::runtime_error("Can't save the checkpoint " + path);
+
+		WriteRun(file, tapeIndex, run, splitPosition);
+		if (!file.flush())
+			throw std::runtime_error("Can't save the checkpoint " + path);
+	}
+
+}
@@ -0,0 +1,447 @@
+#include "SortDaemon.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace TestTask
+{
+
+	namespace
+	{
+		const int ListenBacklog = 64;
+		const size_t MaxRequestLength = 1 << 20;
+
+		using Clock = std::chrono::steady_clock;
+
+		const std::string ProgressReply = "progress ";
+		const std::string DoneReply = "done ";
+		const std::string ErrorReply = "error ";
+
+		std::runtime_error SocketError(const std::string& action, const std::string& socketPath)
+		{ return std::runtime_error("Unable to " + action + " socket " + socketPath + ": " + std::strerror(errno)); }
+
+		sockaddr_un SocketAddress(const std::string& socketPath)
+		{
+			sockaddr_un address{};
+			address.sun_family = AF_UNIX;
+			if (socketPath.size() >= sizeof(address.sun_path))
+				throw std::runtime_error("Socket path " + socketPath + " is too long");
+
+			std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+			return address;
+		}
+
+		void SetSendTimeout(int connection, std::chrono::milliseconds timeout)
+		{
+			timeval time{};
+			time.tv_sec = timeout.count() / 1000;
+			time.tv_usec = timeout.count() % 1000 * 1000;
+			setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &time, sizeof(time));
+		}
+
+		// A client that went away or does not take its reply within the send timeout does not stop
+		// the job, its reply is dropped
+		void WriteLine(int connection, const std::string& text)
+		{
+			const std::string line = text + "\n";
+			for (size_t sent = 0; sent < line.size(); )
+			{
+				const ssize_t count = send(connection, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count <= 0)
+				{
+					// The next lines fail at once instead of waiting for the timeout again
+					shutdown(connection, SHUT_WR);
+					return;
+				}
+
+				sent += count;
+			}
+		}
+
+		bool ReadLine(int connection, std::string& line)
+		{
+			line.clear();
+			char symbol;
+			while (line.size() < MaxRequestLength)
+			{
+				const ssize_t count = recv(connection, &symbol, 1, 0);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count <= 0)
+					return !line.empty();
+				if (symbol == '\n')
+					return true;
+
+				line.push_back(symbol);
+			}
+
+			return false;
+		}
+
+
+		// A connection whose request line has not come in yet
+		struct PendingRequest
+		{
+			int					connection;
+			std::string			line;
+			Clock::time_point	deadline;
+		};
+
+		enum class RequestState
+		{
+			Incomplete,
+			Received,
+			Failed
+		};
+
+		// Takes what the client has sent so far, the connection is readable
+		RequestState Receive(PendingRequest& request)
+		{
+			char buffer[4096];
+			const ssize_t count = recv(request.connection, buffer, sizeof(buffer), 0);
+			if (count < 0)
+				return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ? RequestState::Incomplete : RequestState::Failed;
+			if (count == 0)
+				return request.line.empty() ? RequestState::Failed : RequestState::Received;
+
+			const char* lineEnd = std::find(buffer, buffer + count, '\n');
+			request.line.append(buffer, lineEnd - buffer);
+			if (lineEnd != buffer + count)
+				return RequestState::Received;
+
+			return request.line.size() < MaxRequestLength ? RequestState::Incomplete : RequestState::Failed;
+		}
+
+		int PollTimeout(Clock::time_point deadline)
+		{
+			if (deadline == Clock::time_point::max())
+				return -1;
+
+			const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+			return static_cast<int>(std::clamp<decltype(remaining)>(remaining, 0, std::numeric_limits<int>::max()));
+		}
+
+		bool SetNonBlocking(int descriptor)
+		{
+			const int flags = fcntl(descriptor, F_GETFL);
+			return flags >= 0 && fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) == 0;
+		}
+	}
+
+	SortDaemon::SortDaemon(const TapeFactoryPtr& tapeFactory, const TapeFactoryPtr& temporaryTapeFactory, const std::string& socketPath, const Options& options)
+		:	_tapeFactory(tapeFactory),
+			_socketPath(socketPath),
+			_ordering(options.ordering),
+			_progressInterval(options.progressInterval),
+			_requestTimeout(options.requestTimeout),
+			_replyTimeout(options.replyTimeout),
+			_listenSocket(-1),
+			_stopPipe{-1, -1},
+			_stopping(false)
+	{
+		const size_t threads = std::max<size_t>(options.threads, 1);
+		for (size_t engineIndex = 0; engineIndex < threads; ++engineIndex)
+		{
+			_engines.push_back(std::make_unique<Sort>(temporaryTapeFactory, options.ramSize / threads, options.numberOfTemporaryTapes, options.sortOptions));
+			_idleEngines.push_back(engineIndex);
+		}
+
+		const sockaddr_un address = SocketAddress(_socketPath);
+
+		_listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (_listenSocket < 0)
+			throw SocketError("create", _socketPath);
+
+		unlink(_socketPath.c_str());
+		if (bind(_listenSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+			|| listen(_listenSocket, ListenBacklog) != 0 || !SetNonBlocking(_listenSocket))
+		{
+			const std::runtime_error error = SocketError("listen on", _socketPath);
+			close(_listenSocket);
+			throw error;
+		}
+
+		// Stop writes into the pipe, which Run polls next to the sockets
+		if (pipe(_stopPipe) != 0 || !SetNonBlocking(_stopPipe[0]) || !SetNonBlocking(_stopPipe[1]))
+		{
+			const std::runtime_error error = SocketError("create the stop pipe of", _socketPath);
+			for (const int descriptor : _stopPipe)
+			{
+				if (descriptor >= 0)
+					close(descriptor);
+			}
+			close(_listenSocket);
+			throw error;
+		}
+
+		_pool = std::make_unique<ThreadPool>(threads);
+	}
+
+
+	SortDaemon::~SortDaemon()
+	{
+		// The requests in progress finish before the socket goes away
+		_pool.reset();
+
+		if (_listenSocket >= 0)
+			close(_listenSocket);
+		close(_stopPipe[0]);
+		close(_stopPipe[1]);
+		unlink(_socketPath.c_str());
+	}
+
+
+	void SortDaemon::Run()
+	{
+		// Connections are accepted and their requests read on this thread, each client waits only for its own request
+		std::vector<PendingRequest> pending;
+		std::vector<pollfd> descriptors;
+		while (!_stopping)
+		{
+			descriptors.assign({{_stopPipe[0], POLLIN, 0}, {_listenSocket, POLLIN, 0}});
+			Clock::time_point deadline = Clock::time_point::max();
+			for (const PendingRequest& request : pending)
+			{
+				descriptors.push_back({request.connection, POLLIN, 0});
+				deadline = std::min(deadline, request.deadline);
+			}
+
+			if (poll(descriptors.data(), descriptors.size(), PollTimeout(deadline)) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				throw SocketError("poll", _socketPath);
+			}
+
+			if (descriptors[0].revents != 0)
+				break;
+
+			// The requests of the connections polled above, the new ones are polled next time
+			std::vector<PendingRequest> stillPending;
+			const auto now = Clock::now();
+			for (size_t idx = 0; idx < pending.size(); ++idx)
+			{
+				PendingRequest& request = pending[idx];
+				const RequestState state = descriptors[idx + 2].revents != 0 ? Receive(request) : RequestState::Incomplete;
+
+				if (state == RequestState::Received)
+				{
+					_pool->Submit([this, connection = request.connection, line = std::move(request.line)]() { Serve(connection, line); });
+					continue;
+				}
+
+				if (state == RequestState::Failed || now >= request.deadline)
+				{
+					WriteLine(request.connection, ErrorReply + (state == RequestState::Failed ? std::string("Incomplete request")
+						: "No request within " + std::to_string(_requestTimeout.count()) + " ms"));
+					close(request.connection);
+					continue;
+				}
+
+				stillPending.push_back(std::move(request));
+			}
+			pending = std::move(stillPending);
+
+			if (descriptors[1].revents == 0)
+				continue;
+
+			for (;;)
+			{
+				const int connection = accept(_listenSocket, nullptr, nullptr);
+				if (connection < 0)
+				{
+					if (errno == EINTR || errno == ECONNABORTED)
+						continue;
+					if (errno == EAGAIN || errno == EWOULDBLOCK)
+						break;
+
+					throw SocketError("accept on", _socketPath);
+				}
+
+				SetSendTimeout(connection, _replyTimeout);
+				pending.push_back({connection, std::string(), Clock::now() + _requestTimeout});
+			}
+		}
+
+		// New clients are refused at once
+		close(_listenSocket);
+		_listenSocket = -1;
+
+		for (const PendingRequest& request : pending)
+		{
+			WriteLine(request.connection, ErrorReply + "The daemon is shutting down");
+			close(request.connection);
+		}
+
+		// Destroying the pool waits for the accepted requests
+		_pool.reset();
+	}
+
+
+	void SortDaemon::Stop()
+	{
+		// Wakes up the poll of Run, a full pipe has woken it already
+		_stopping = true;
+		const char signal = 0;
+		const ssize_t written = write(_stopPipe[1], &signal, 1);
+		static_cast<void>(written);
+	}
+
+
+	void SortDaemon::Serve(int connection, const std::string& line)
+	{
+		try
+		{
+			std::istringstream lineStream(line);
+			std::vector<std::string> arguments;
+			for (std::string argument; lineStream >> argument; )
+				arguments.push_back(argument);
+
+			const SortRequest request = ParseSortRequest(arguments, _ordering);
+			if (request.mode == SortRequest::Mode::Shutdown)
+			{
+				WriteLine(connection, DoneReply + "shutdown");
+				Stop();
+			}
+			else if (request.mode == SortRequest::Mode::Sort || request.mode == SortRequest::Mode::Merge)
+			{
+				const size_t engineIndex = AcquireEngine();
+				try
+				{
+					Execute(request, *_engines[engineIndex], connection);
+				}
+				catch (...)
+				{
+					ReleaseEngine(engineIndex);
+					throw;
+				}
+				ReleaseEngine(engineIndex);
+			}
+			else
+				throw std::runtime_error("The daemon serves only sort and merge requests");
+		}
+		catch (const std::exception& e)
+		{
+			WriteLine(connection, ErrorReply + e.what());
+		}
+
+		close(connection);
+	}
+
+
+	void SortDaemon::Execute(const SortRequest& request, Sort& engine, int connection)
+	{
+		const auto started = std::chrono::steady_clock::now();
+
+		// Every request puts its own connection into the callback of the engine
+		SortProgressCallback progressCallback;
+		if (_progressInterval.count() != 0)
+		{
+			progressCallback = [connection](const SortProgress& progress)
+			{
+				std::ostringstream line;
+				line << progress;
+				WriteLine(connection, ProgressReply + line.str());
+			};
+		}
+		engine.SetProgressCallback(progressCallback, _progressInterval);
+
+		if (request.mode == SortRequest::Mode::Merge)
+		{
+			std::vector<std::unique_ptr<ITape>> inputTapes;
+			for (size_t tapeIndex = 1; tapeIndex < request.tapeNames.size(); ++tapeIndex)
+				inputTapes.push_back(_tapeFactory->CreateInput(request.tapeNames[tapeIndex]));
+
+			const auto outputTape = _tapeFactory->Create(request.tapeNames.front());
+
+			WriteLine(connection, ProgressReply + "Merge of " + std::to_string(inputTapes.size()) + " sorted tapes");
+			engine.MergeTapes(inputTapes, outputTape, request.verifyInputs, request.ordering);
+		}
+		else
+		{
+			const auto inputTape = _tapeFactory->CreateInput(request.tapeNames[0]);
+			const auto outputTape = _tapeFactory->Create(request.tapeNames[1]);
+
+			std::ostringstream plan;
+			plan << engine.Plan(inputTape->Length());
+			WriteLine(connection, ProgressReply + plan.str());
+
+			engine.SortData(inputTape, outputTape, request.ordering, request.resume);
+		}
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+		WriteLine(connection, DoneReply + "outputLength=" + std::to_string(engine.OutputLength())
+			+ " seconds=" + std::to_string(elapsed.count())
+			+ " peakMemory=" + std::to_string(engine.Memory().Peak()));
+	}
+
+
+	size_t SortDaemon::AcquireEngine()
+	{
+		std::unique_lock<std::mutex> lock(_enginesMutex);
+		_engineReleased.wait(lock, [this] { return !_idleEngines.empty(); });
+
+		const size_t engineIndex = _idleEngines.back();
+		_idleEngines.pop_back();
+		return engineIndex;
+	}
+
+
+	void SortDaemon::ReleaseEngine(size_t engineIndex)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_enginesMutex);
+			_idleEngines.push_back(engineIndex);
+		}
+		_engineReleased.notify_one();
+	}
+
+
+	bool SendSortRequest(const std::string& socketPath, const std::vector<std::string>& arguments, std::ostream& reply)
+	{
+		const sockaddr_un address = SocketAddress(socketPath);
+
+		const int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (connection < 0)
+			throw SocketError("create", socketPath);
+
+		if (connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			const std::runtime_error error = SocketError("connect to", socketPath);
+			close(connection);
+			throw error;
+		}
+
+		std::string request;
+		for (const std::string& argument : arguments)
+			request += (request.empty() ? "" : " ") + argument;
+		WriteLine(connection, request);
+
+		// The last line tells the outcome
+		bool succeeded = false;
+		std::string line;
+		while (ReadLine(connection, line))
+		{
+			reply << line << std::endl;
+			succeeded = line.rfind(DoneReply, 0) == 0;
+		}
+
+		close(connection);
+		return succeeded;
+	}
+
+}
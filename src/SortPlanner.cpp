@@ -0,0 +1,305 @@
+#include "SortPlanner.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "ChunkSorter.h"
+#include "LoserTree.h"
+#include "MemoryGovernor.h"
+#include "MergeStreams.h"
+#include "RunDirectory.h"
+
+namespace TestTask
+{
+
+	namespace
+	{
+		const size_t MinFanIn = 2;
+
+		size_t DivideRoundingUp(size_t dividend, size_t divisor)
+		{ return dividend / divisor + (dividend % divisor != 0 ? 1 : 0); }
+	}
+
+
+	std::ostream& operator<<(std::ostream& stream, const SortPlan& plan)
+	{
+		if (plan.algorithm == SortPlan::Algorithm::InMemory)
+			stream << "Sort plan: in-memory sort";
+		else if (plan.algorithm == SortPlan::Algorithm::TopK)
+			stream << "Sort plan: top-K selection";
+		else
+		{
+			stream << "Sort plan: external merge"
+				<< (plan.pipelinedSplit ? ", pipelined split" : "");
+
+			if (plan.splitThreads > 1)
+				stream << ", " << plan.splitThreads << " split threads";
+
+			stream
+				<< ", " << plan.runsCount << " runs, fan-in " << plan.fanIn
+				<< ", " << plan.mergePasses << " merge passes"
+				<< ", merge buffers " << plan.mergeBufferSize << " elements";
+		}
+
+		return stream << ", chunk " << plan.chunkCapacity << " elements"
+			<< ", scratch " << plan.scratchCapacity << " elements"
+			<< ", predicted time " << plan.predictedTime / 1000 << " ms";
+	}
+
+
+	SortPlanner::SortPlanner(const Limits& limits)
+		:	_limits(limits)
+	{ }
+
+
+	SortPlan SortPlanner::Plan(size_t tapeLength) const
+	{
+		const double cellCost = static_cast<double>(_limits.tapeCost.readWriteDelay + _limits.tapeCost.rewindDelay);
+
+		SortPlan best;
+
+		// Reading the input once and writing K elements beats any sort that writes them all
+		if (_limits.topK != 0 && _limits.topK < tapeLength && _limits.topK <= _limits.ramDataCapacity)
+		{
+			best.algorithm = SortPlan::Algorithm::TopK;
+			best.chunkCapacity = _limits.topK;
+			best.runsCount = 1;
+			best.predictedTime = cellCost * (tapeLength + _limits.topK);
+			best.predictedSplitTime = cellCost * tapeLength;
+			return best;
+		}
+
+		if (tapeLength <= _limits.ramDataCapacity)
+		{
+			best.algorithm = SortPlan::Algorithm::InMemory;
+			best.chunkCapacity = tapeLength;
+			best.scratchCapacity = _limits.ramDataCapacity - tapeLength;
+			best.runsCount = 1;
+			best.predictedTime = 2 * cellCost * tapeLength;
+			best.predictedSplitTime = cellCost * tapeLength;
+			return best;
+		}
+
+		bool found = false;
+		for (const bool pipelinedSplit : {false, true})
+		{
+			if (pipelinedSplit && !_limits.pipelinedSplit)
+				continue;
+
+			// The pipelined split has its own reader, sorter and writer threads
+			std::vector<size_t> splitThreadsCounts = {1};
+			if (!pipelinedSplit && _limits.splitThreads > 1)
+				splitThreadsCounts.push_back(_limits.splitThreads);
+
+			for (const size_t splitThreads : splitThreadsCounts)
+			{
+				for (const bool useScratch : {true, false})
+				{
+					for (size_t fanIn = MinFanIn; fanIn <= std::max(_limits.maxFanIn, MinFanIn); ++fanIn)
+					{
+						SortPlan candidate;
+						if (!Evaluate(tapeLength, pipelinedSplit, splitThreads, useScratch, fanIn, candidate))
+							break;
+
+						if (!found || IsBetter(candidate, best))
+						{
+							best = candidate;
+							found = true;
+						}
+
+						// A wider fan-in can not reduce the number of runs merged by the last pass any further
+						if (fanIn >= candidate.runsCount)
+							break;
+					}
+				}
+			}
+		}
+
+		if (!found)
+			throw std::runtime_error("RAM size is too small for any sort plan");
+
+		return best;
+	}
+
+
+	bool SortPlanner::Evaluate(size_t tapeLength, bool pipelinedSplit, size_t splitThreads, bool useScratch, size_t fanIn, SortPlan& plan) const
+	{
+		const TapeCost& cost = _limits.tapeCost;
+		const double cellCost = static_cast<double>(cost.readWriteDelay + cost.rewindDelay);
+
+		// Every split thread sorts its chunks with its own scratch buffer
+		const size_t buffersCount = pipelinedSplit ? PipelineBuffersCount : splitThreads;
+		const size_t sortersCount = pipelinedSplit ? 1 : splitThreads;
+		const size_t chunksPerBuffer = buffersCount + (useScratch ? sortersCount : 0);
+
+		size_t dataCapacity = _limits.ramDataCapacity;
+		size_t chunkCapacity = dataCapacity / chunksPerBuffer;
+		size_t directoryMemory = 0;
+
+		if (_limits.memoryLimit != 0)
+		{
+			// Chunks shrink until the run directories they produce fit next to them
+			while (chunkCapacity > 0)
+			{
+				const size_t runsCount = DivideRoundingUp(tapeLength, chunkCapacity);
+				directoryMemory = RunDirectoriesMemory(std::min(fanIn, runsCount), runsCount);
+				if (directoryMemory >= _limits.memoryLimit)
+					return false;
+
+				dataCapacity = (_limits.memoryLimit - directoryMemory) / sizeof(int32_t);
+				if (chunkCapacity <= dataCapacity / chunksPerBuffer)
+					break;
+
+				chunkCapacity = dataCapacity / chunksPerBuffer;
+			}
+		}
+
+		if (chunkCapacity == 0 || (useScratch && chunkCapacity < ChunkSorter::ScratchThreshold()))
+			return false;
+
+		plan.algorithm = SortPlan::Algorithm::ExternalMerge;
+		plan.pipelinedSplit = pipelinedSplit;
+		plan.chunkCapacity = chunkCapacity;
+		plan.scratchCapacity = useScratch ? dataCapacity - buffersCount * chunkCapacity : 0;
+		plan.runsCount = DivideRoundingUp(tapeLength, chunkCapacity);
+		plan.fanIn = fanIn;
+
+		size_t inputTapesCount = std::min(fanIn, plan.runsCount);
+
+		const size_t mergeMemory = _limits.memoryLimit != 0 ? _limits.memoryLimit - directoryMemory : MemoryGovernor::Unlimited;
+		if (ConcurrentMerges(inputTapesCount, 1, mergeMemory) == 0)
+			return false;
+
+		// Each split thread writes its own temporary tapes
+		plan.splitThreads = std::min(splitThreads, inputTapesCount);
+
+		// Reading the input and writing the runs overlap when the split is pipelined
+		const double splitTime = cellCost * tapeLength * (pipelinedSplit ? 1 : 2) / plan.splitThreads;
+
+		size_t seriesCount = DivideRoundingUp(plan.runsCount, inputTapesCount);
+		double mergeTime = 0;
+		plan.mergePasses = 1;
+
+		while (seriesCount > 1)
+		{
+			const size_t outputTapesCount = std::min(fanIn, seriesCount);
+
+			const size_t mergesCount = std::max<size_t>(ConcurrentMerges(inputTapesCount, outputTapesCount, mergeMemory), 1);
+			const MergeBuffers buffers = PlanMergeBuffers(inputTapesCount, mergesCount, mergeMemory);
+			if (plan.mergePasses == 1)
+				plan.mergeBufferSize = buffers.inputBufferSize;
+
+			mergeTime += MergePassTime(tapeLength, mergesCount, buffers) + static_cast<double>(cost.rewindDelay) * seriesCount * inputTapesCount;
+
+			inputTapesCount = outputTapesCount;
+			seriesCount = DivideRoundingUp(seriesCount, outputTapesCount);
+			++plan.mergePasses;
+		}
+
+		const MergeBuffers buffers = PlanMergeBuffers(inputTapesCount, 1, mergeMemory);
+		if (plan.mergePasses == 1)
+			plan.mergeBufferSize = buffers.inputBufferSize;
+
+		mergeTime += MergePassTime(tapeLength, 1, buffers) + static_cast<double>(cost.rewindDelay) * inputTapesCount;
+
+		plan.predictedTime = splitTime + mergeTime;
+		plan.predictedSplitTime = splitTime;
+		return true;
+	}
+
+
+	size_t SortPlanner::ConcurrentMerges(size_t inputTapesCount, size_t outputTapesCount, size_t availableMemory) const
+	{
+		// Each concurrent merge holds a loser tree of inputTapesCount elements in RAM
+		// and keeps its own input heads plus one output tape open
+		size_t mergesCount = std::min(_limits.parallelTapeDrives, outputTapesCount);
+		mergesCount = std::min(mergesCount, _limits.ramDataCapacity / inputTapesCount);
+		mergesCount = std::min(mergesCount, _limits.maxOpenTapes / (inputTapesCount + 1));
+		return std::min(mergesCount, availableMemory / (MergeMemory(inputTapesCount) + MergeBuffersMemory(inputTapesCount, MergeBuffers())));
+	}
+
+
+	size_t SortPlanner::MaxFanIn(size_t availableMemory) const
+	{
+		for (size_t fanIn = std::max(_limits.maxFanIn, MinFanIn); fanIn >= MinFanIn; --fanIn)
+		{
+			if (ConcurrentMerges(fanIn, 1, availableMemory) != 0)
+				return fanIn;
+		}
+
+		return 0;
+	}
+
+
+	SortPlanner::MergeBuffers SortPlanner::PlanMergeBuffers(size_t inputsCount, size_t mergesCount, size_t availableMemory) const
+	{
+		size_t dataCapacity = _limits.ramDataCapacity;
+		if (availableMemory != MemoryGovernor::Unlimited)
+		{
+			const size_t treesMemory = std::min(mergesCount * MergeMemory(inputsCount), availableMemory);
+			dataCapacity = std::min(dataCapacity, (availableMemory - treesMemory) / sizeof(int32_t));
+		}
+
+		MergeBuffers buffers;
+		buffers.inputBufferSize = dataCapacity / mergesCount / (inputsCount + 3);
+
+		// Too little RAM for prefetch and output buffers, every input run still holds one element
+		if (buffers.inputBufferSize == 0)
+			buffers.inputBufferSize = 1;
+		else
+		{
+			buffers.outputBufferSize = buffers.inputBufferSize;
+			buffers.prefetch = true;
+		}
+
+		return buffers;
+	}
+
+
+	double SortPlanner::MergePassTime(size_t tapeLength, size_t mergesCount, const MergeBuffers& buffers) const
+	{
+		const TapeCost& cost = _limits.tapeCost;
+		const double length = static_cast<double>(tapeLength);
+
+		// Every block transfer costs one rewind
+		const double readTime = length * cost.readWriteDelay + DivideRoundingUp(tapeLength, buffers.inputBufferSize) * static_cast<double>(cost.rewindDelay);
+		const double writeTime = length * cost.readWriteDelay
+			+ DivideRoundingUp(tapeLength, std::max<size_t>(buffers.outputBufferSize, 1)) * static_cast<double>(cost.rewindDelay);
+
+		// Prefetched blocks are read and output buffers are written in the background while the merge goes on
+		const double passTime = buffers.prefetch ? std::max(readTime, writeTime) : readTime + writeTime;
+		return passTime / mergesCount;
+	}
+
+
+	size_t SortPlanner::MergeMemory(size_t inputsCount)
+	{ return LoserTree::MemoryBytes(inputsCount) + inputsCount * sizeof(size_t) + MergeInputs::MemoryBytes(inputsCount); }
+
+
+	size_t SortPlanner::MergeBuffersMemory(size_t inputsCount, const MergeBuffers& buffers)
+	{ return ((inputsCount + (buffers.prefetch ? 1 : 0)) * buffers.inputBufferSize + 2 * buffers.outputBufferSize) * sizeof(int32_t); }
+
+
+	size_t SortPlanner::RunDirectoriesMemory(size_t tapesCount, size_t runsCount)
+	{
+		// The natural runs split may add the presorted part of the input as one more run
+		return 2 * RunDirectory::MemoryBytes(tapesCount, runsCount + 1);
+	}
+
+
+	bool SortPlanner::IsBetter(const SortPlan& candidate, const SortPlan& best)
+	{
+		// Two passes over the data (split and one merge) whenever they are possible
+		const bool candidateTwoPass = candidate.mergePasses == 1;
+		const bool bestTwoPass = best.mergePasses == 1;
+		if (candidateTwoPass != bestTwoPass)
+			return candidateTwoPass;
+
+		if (candidate.predictedTime != best.predictedTime)
+			return candidate.predictedTime < best.predictedTime;
+
+		return candidate.mergePasses < best.mergePasses;
+	}
+
+}
@@ -0,0 +1,135 @@
+#include "SortProgress.h"
+
+#include <algorithm>
+
+namespace TestTask
+{
+
+	std::ostream& operator<<(std::ostream& stream, const SortProgress& progress)
+	{
+		switch (progress.phase)
+		{
+		case SortProgress::Phase::RunGeneration:
+			stream << "Progress: run generation";
+			break;
+
+		case SortProgress::Phase::Merge:
+			stream << "Progress: merge pass " << progress.pass << " of " << progress.passesCount;
+			break;
+
+		case SortProgress::Phase::Done:
+			return stream << "Progress: done, " << progress.totalCells << " elements";
+		}
+
+		const size_t percent = progress.totalCells != 0 ? progress.processedCells * 100 / progress.totalCells : 100;
+		stream << ", " << percent << "% of " << progress.totalCells << " elements";
+
+		if (progress.remainingTime > 0)
+			stream << ", predicted remaining time " << progress.remainingTime / 1000 << " ms";
+
+		return stream;
+	}
+
+
+	SortProgressMeter::SortProgressMeter()
+		:	_interval(Clock::duration::zero()),
+			_processedCells(0),
+			_splitTime(0),
+			_passTime(0)
+	{ }
+
+
+	void SortProgressMeter::SetCallback(SortProgressCallback callback, std::chrono::milliseconds interval)
+	{
+		_callback = std::move(callback);
+		_interval = interval;
+	}
+
+
+	void SortProgressMeter::StartJob(const SortPlan& plan, size_t inputLength)
+	{
+		if (!_callback)
+			return;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// An in-memory sort has no merge passes, the writing of its output follows the run generation
+		_splitTime = plan.mergePasses != 0 ? plan.predictedSplitTime : plan.predictedTime;
+		_passTime = plan.mergePasses != 0 ? (plan.predictedTime - plan.predictedSplitTime) / plan.mergePasses : 0;
+
+		_progress = SortProgress();
+		_progress.passesCount = plan.mergePasses;
+		_progress.totalCells = inputLength;
+		_processedCells = 0;
+
+		Report();
+	}
+
+
+	void SortProgressMeter::StartMergePass(size_t passesLeft)
+	{
+		if (!_callback)
+			return;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_progress.phase = SortProgress::Phase::Merge;
+		_progress.passesCount = std::max(_progress.passesCount, passesLeft);
+		_progress.pass = _progress.passesCount - passesLeft + 1;
+		_processedCells = 0;
+
+		Report();
+	}
+
+
+	void SortProgressMeter::FinishJob()
+	{
+		if (!_callback)
+			return;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_progress.phase = SortProgress::Phase::Done;
+		_processedCells = _progress.totalCells;
+
+		Report();
+	}
+
+
+	void SortProgressMeter::Count(size_t cells)
+	{
+		_processedCells.fetch_add(cells, std::memory_order_relaxed);
+
+		// A thread that finds another one reporting goes on with its work
+		std::unique_lock<std::mutex> lock(_mutex, std::try_to_lock);
+		if (lock.owns_lock() && Clock::now() - _lastReport >= _interval)
+			Report();
+	}
+
+
+	void SortProgressMeter::Report()
+	{
+		SortProgress progress = _progress;
+		progress.processedCells = std::min(_processedCells.load(std::memory_order_relaxed), progress.totalCells);
+
+		const double passLeft = progress.totalCells != 0 ? 1 - static_cast<double>(progress.processedCells) / progress.totalCells : 0;
+		switch (progress.phase)
+		{
+		case SortProgress::Phase::RunGeneration:
+			progress.remainingTime = _splitTime * passLeft + _passTime * progress.passesCount;
+			break;
+
+		case SortProgress::Phase::Merge:
+			progress.remainingTime = _passTime * (progress.passesCount - progress.pass + passLeft);
+			break;
+
+		case SortProgress::Phase::Done:
+			progress.remainingTime = 0;
+			break;
+		}
+
+		_lastReport = Clock::now();
+		_callback(progress);
+	}
+
+}
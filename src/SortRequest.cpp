@@ -0,0 +1,86 @@
+#include "SortRequest.h"
+
+#include <stdexcept>
+
+namespace TestTask
+{
+
+	namespace
+	{
+		const std::string OrderOption = "--order=";
+		const std::string MergeOption = "--merge";
+		const std::string VerifyOption = "--verify";
+		const std::string ResumeOption = "--resume";
+		const std::string BatchOption = "--batch";
+		const std::string DaemonOption = "--daemon";
+		const std::string ShutdownOption = "--shutdown";
+	}
+
+	SortRequest ParseSortRequest(const std::vector<std::string>& arguments, Ordering defaultOrdering)
+	{
+		// The order of the command line overrides the default one
+		SortRequest request;
+		request.ordering = defaultOrdering;
+
+		for (const std::string& argument : arguments)
+		{
+			if (argument.rfind(OrderOption, 0) == 0)
+				request.ordering = ParseOrdering(argument.substr(OrderOption.size()));
+			else if (argument == MergeOption)
+				request.mode = SortRequest::Mode::Merge;
+			else if (argument == VerifyOption)
+				request.verifyInputs = true;
+			else if (argument == ResumeOption)
+				request.resume = true;
+			else if (argument == BatchOption)
+				request.mode = SortRequest::Mode::Batch;
+			else if (argument == DaemonOption)
+				request.mode = SortRequest::Mode::Daemon;
+			else if (argument == ShutdownOption)
+				request.mode = SortRequest::Mode::Shutdown;
+			else if (argument.rfind("--", 0) == 0)
+				throw std::runtime_error("Unknown option " + argument);
+			else
+				request.tapeNames.push_back(argument);
+		}
+
+		bool validCount = false;
+		switch (request.mode)
+		{
+		case SortRequest::Mode::Sort:
+			validCount = request.tapeNames.size() == 2;
+			break;
+
+		case SortRequest::Mode::Merge:
+			validCount = request.tapeNames.size() >= 2;
+			break;
+
+		case SortRequest::Mode::Batch:
+		case SortRequest::Mode::Daemon:
+			validCount = request.tapeNames.size() == 1;
+			break;
+
+		case SortRequest::Mode::Shutdown:
+			validCount = request.tapeNames.empty();
+			break;
+		}
+
+		if (!validCount)
+			throw std::runtime_error("Wrong number of tapes");
+
+		if (request.resume && request.mode != SortRequest::Mode::Sort)
+			throw std::runtime_error("Only a sort can be resumed");
+
+		return request;
+	}
+
+
+	void PrintUsage(std::ostream& stream)
+	{
+		stream << "Usage: testTask <inputTape> <outputTape> [" << OrderOption << "ascending|descending|unsigned] [" << ResumeOption << "]" << std::endl
+			<< "       testTask " << MergeOption << " <outputTape> <sortedInputTape>... [" << VerifyOption << "] [" << OrderOption << "...]" << std::endl
+			<< "       testTask " << BatchOption << " <jobsFile> [" << OrderOption << "...]" << std::endl
+			<< "       testTask " << DaemonOption << " <socketPath> [" << OrderOption << "...]" << std::endl;
+	}
+
+}
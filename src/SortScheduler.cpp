@@ -0,0 +1,207 @@
+#include "SortScheduler.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+namespace TestTask
+{
+
+	namespace
+	{
+		// The input and the output tape of a job
+		const size_t JobTapesCount = 2;
+
+		// An external merge of two runs reads two temporary tapes and writes two more
+		const size_t MinMergeTapesCount = 4;
+
+		double Seconds(std::chrono::steady_clock::duration duration)
+		{ return std::chrono::duration<double>(duration).count(); }
+	}
+
+	SortScheduler::SortScheduler(const TapeFactoryPtr& tapeFactory, const TapeFactoryPtr& temporaryTapeFactory, const Options& options)
+		:	_tapeFactory(tapeFactory),
+			_maxActiveTapes(options.maxActiveTapes),
+			_parallelTapeDrives(std::max<size_t>(options.sortOptions.parallelTapeDrives, 1)),
+			_activeJobs(0),
+			_activeTapes(0),
+			_totalLatency(0),
+			_totalQueueTime(0)
+	{
+		if (_maxActiveTapes < JobTapesCount + MinMergeTapesCount)
+			throw std::runtime_error("Active tape limit is too small for an external sort");
+
+		const size_t threads = std::max<size_t>(options.threads, 1);
+		const size_t jobRamSize = options.jobRamSize != 0 ? options.jobRamSize : options.ramSize / threads;
+		if (jobRamSize == 0 || jobRamSize > options.ramSize)
+			throw std::runtime_error("RAM size is too small for a sort job");
+
+		// Every engine may keep all the active tapes but the input and the output of its job
+		SortOptions sortOptions = options.sortOptions;
+		_engineOpenTapes = _maxActiveTapes - JobTapesCount;
+		if (sortOptions.maxOpenTapes != 0)
+			_engineOpenTapes = std::min(_engineOpenTapes, sortOptions.maxOpenTapes);
+		sortOptions.maxOpenTapes = _engineOpenTapes;
+
+		const size_t enginesCount = std::min(threads, options.ramSize / jobRamSize);
+		for (size_t engineIndex = 0; engineIndex < enginesCount; ++engineIndex)
+		{
+			_engines.push_back(std::make_unique<Sort>(temporaryTapeFactory, jobRamSize, options.numberOfTemporaryTapes, sortOptions));
+			_idleEngines.push_back(enginesCount - engineIndex - 1);
+		}
+
+		_pool = std::make_unique<ThreadPool>(enginesCount);
+	}
+
+
+	SortScheduler::~SortScheduler()
+	{ Wait(); }
+
+
+	size_t SortScheduler::Submit(const SortJob& job)
+	{
+		// The plan decides how many tapes the job keeps active, all the engines plan alike.
+		// A missing input is not made up here, its job fails once it runs.
+		const size_t tapeLength = _tapeFactory->Exists(job.inputTape) ? _tapeFactory->Create(job.inputTape)->Length() : 0;
+		const size_t tapesCount = ActiveTapes(_engines.front()->Plan(tapeLength));
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		const Clock::time_point now = Clock::now();
+		if (_stats.submittedJobs == 0)
+			_firstSubmission = now;
+
+		SortJobResult result;
+		result.job = job;
+
+		const size_t index = _results.size();
+		_results.push_back(result);
+		_pendingJobs.push_back({index, job, tapesCount, now});
+		++_stats.submittedJobs;
+
+		Dispatch();
+		return index;
+	}
+
+
+	std::vector<SortJobResult> SortScheduler::Wait()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_jobFinished.wait(lock, [this] { return _pendingJobs.empty() && _activeJobs == 0; });
+
+		return _results;
+	}
+
+
+	SchedulerStats SortScheduler::Stats() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		SchedulerStats stats = _stats;
+		if (stats.submittedJobs == 0)
+			return stats;
+
+		stats.elapsedSeconds = Seconds(Clock::now() - _firstSubmission);
+		if (stats.elapsedSeconds > 0)
+		{
+			stats.jobsPerSecond = (stats.completedJobs + stats.failedJobs) / stats.elapsedSeconds;
+			stats.elementsPerSecond = stats.sortedElements / stats.elapsedSeconds;
+		}
+
+		const size_t finishedJobs = stats.completedJobs + stats.failedJobs;
+		if (finishedJobs != 0)
+		{
+			stats.meanLatencySeconds = _totalLatency / finishedJobs;
+			stats.meanQueueSeconds = _totalQueueTime / finishedJobs;
+		}
+
+		return stats;
+	}
+
+
+	size_t SortScheduler::ActiveTapes(const SortPlan& plan) const
+	{
+		if (plan.algorithm != SortPlan::Algorithm::ExternalMerge)
+			return JobTapesCount;
+
+		// A merge pass reads fan-in temporary tapes and writes as many, concurrent merges open their own heads
+		return JobTapesCount + std::min(_engineOpenTapes, 2 * plan.fanIn * _parallelTapeDrives);
+	}
+
+
+	void SortScheduler::Dispatch()
+	{
+		// Jobs start in the submission order, so a large job is not overtaken forever by small ones
+		while (!_pendingJobs.empty() && !_idleEngines.empty())
+		{
+			const PendingJob pendingJob = _pendingJobs.front();
+			if (_activeTapes + pendingJob.tapesCount > _maxActiveTapes)
+				break;
+
+			_pendingJobs.pop_front();
+
+			const size_t engineIndex = _idleEngines.back();
+			_idleEngines.pop_back();
+
+			_activeTapes += pendingJob.tapesCount;
+			++_activeJobs;
+			_stats.peakActiveTapes = std::max(_stats.peakActiveTapes, _activeTapes);
+			_stats.peakActiveJobs = std::max(_stats.peakActiveJobs, _activeJobs);
+
+			_pool->Submit([this, pendingJob, engineIndex]() { Run(pendingJob, engineIndex); });
+		}
+	}
+
+
+	void SortScheduler::Run(const PendingJob& pendingJob, size_t engineIndex)
+	{
+		const Clock::time_point started = Clock::now();
+
+		size_t outputLength = 0;
+		std::string error;
+		try
+		{
+			const auto inputTape = _tapeFactory->CreateInput(pendingJob.job.inputTape);
+			const auto outputTape = _tapeFactory->Create(pendingJob.job.outputTape);
+
+			Sort& engine = *_engines[engineIndex];
+			engine.SortData(inputTape, outputTape, pendingJob.job.ordering);
+			outputLength = engine.OutputLength();
+		}
+		catch (const std::exception& e)
+		{
+			error = e.what();
+		}
+
+		const Clock::time_point finished = Clock::now();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		SortJobResult& result = _results[pendingJob.index];
+		result.outputLength = outputLength;
+		result.queueSeconds = Seconds(started - pendingJob.submitted);
+		result.runSeconds = Seconds(finished - started);
+		result.error = error;
+
+		if (error.empty())
+		{
+			++_stats.completedJobs;
+			_stats.sortedElements += outputLength;
+		}
+		else
+			++_stats.failedJobs;
+
+		const double latency = Seconds(finished - pendingJob.submitted);
+		_totalLatency += latency;
+		_totalQueueTime += result.queueSeconds;
+		_stats.maxLatencySeconds = std::max(_stats.maxLatencySeconds, latency);
+
+		_activeTapes -= pendingJob.tapesCount;
+		--_activeJobs;
+		_idleEngines.push_back(engineIndex);
+
+		Dispatch();
+		_jobFinished.notify_all();
+	}
+
+}
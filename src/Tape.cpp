@@ -1,5 +1,6 @@
 #include "Tape.h"
 
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <iostream>
@@ -90,6 +91,54 @@ namespace TestTask
 	{ DoWrite(data, false); }
 
 
+	void Tape::ReadBlock(int32_t* data, size_t count, Direction direction)
+	{
+		if (count == 0)
+			return;
+
+		if (!_tapeBand.is_open() || _tapeBand.tellp() == -1)
+			throw std::runtime_error("Bad tape " + _tapeName);
+
+		// A backward block occupies the cells currentPos - count + 1 ... currentPos
+		if (direction == Direction::Backward && count > _currentPos)
+			throw std::out_of_range("Unable to read the block backward");
+
+		const size_t firstCell = direction == Direction::Forward ? _currentPos : _currentPos - count + 1;
+		_tapeBand.seekg((firstCell - 1) * IntSize, std::ios_base::beg);
+		_tapeBand.read(reinterpret_cast<char*>(data), count * IntSize);
+
+		if (!_tapeBand)
+			throw std::runtime_error("Unable to read the block from the tape " + _tapeName);
+
+		if (direction == Direction::Backward)
+			std::reverse(data, data + count);
+
+		const size_t nextCell = direction == Direction::Forward ? _currentPos + count : std::max<size_t>(firstCell - 1, 1);
+		_tapeBand.seekp((nextCell - 1) * IntSize, std::ios_base::beg);
+		_currentPos = nextCell;
+
+		std::this_thread::sleep_for(std::chrono::microseconds(count * _readWriteDelay + _rewindDelay));
+	}
+
+
+	void Tape::WriteBlock(const int32_t* data, size_t count)
+	{
+		if (count == 0)
+			return;
+
+		if (!_tapeBand.is_open() || _tapeBand.tellp() == -1)
+			throw std::runtime_error("Bad tape " + _tapeName);
+
+		_tapeBand.write(reinterpret_cast<const char*>(data), count * IntSize);
+
+		_currentPos += count;
+		if (_currentPos - 1 > _length)
+			_length = _currentPos - 1;
+
+		std::this_thread::sleep_for(std::chrono::microseconds(count * _readWriteDelay + _rewindDelay));
+	}
+
+
 	void Tape::RewindTape(size_t numberOfPositions, Direction direction)
 	{
 		if (numberOfPositions == 0)
@@ -128,6 +177,30 @@ namespace TestTask
 	}
 
 
+	void Tape::Flush()
+	{
+		if (!_tapeBand.flush())
+			throw std::runtime_error("Unable to flush the tape " + _tapeName);
+	}
+
+
+	void Tape::Truncate(size_t length)
+	{
+		if (length >= _length)
+			return;
+
+		Flush();
+		std::filesystem::resize_file(_tapeName, length * IntSize);
+		_length = length;
+
+		if (_currentPos > _length + 1)
+		{
+			_tapeBand.seekp(_length * IntSize, std::ios_base::beg);
+			_currentPos = _length + 1;
+		}
+	}
+
+
 	int32_t Tape::DoRead()
 	{
 		if (!_tapeBand.is_open() || _tapeBand.tellp() == -1)
@@ -185,21 +258,19 @@ namespace TestTask
 
 	void Tape::DoRewind(size_t steps, Direction direction)
 	{
-		int8_t dataUnitSize;
+		// One relative seek, so rewinding across billions of cells costs no more than a single step
+		const std::streamoff offset = static_cast<std::streamoff>(steps) * IntSize;
 		switch (direction)
 		{
 		case Direction::Forward:
-			dataUnitSize = IntSize;
+			_tapeBand.seekp(offset, std::ios_base::cur);
 			break;
 
 		case Direction::Backward:
-			dataUnitSize = -IntSize;
+			_tapeBand.seekp(-offset, std::ios_base::cur);
 			break;
 		}
 
-		for (size_t step = 0; step < steps; ++step)
-			_tapeBand.seekp(dataUnitSize, std::ios_base::cur);
-
 		_currentPos = (_tapeBand.tellp() / 4) + 1;
 
 		std::this_thread::sleep_for(std::chrono::microseconds(_rewindDelay));
@@ -0,0 +1,57 @@
+#include "ThreadPool.h"
+
+#include <memory>
+
+namespace TestTask
+{
+
+	ThreadPool::ThreadPool(size_t threadsCount)
+	{
+		for (size_t threadIndex = 0; threadIndex < threadsCount; ++threadIndex)
+		{
+			_workers.emplace_back([this]()
+			{
+				std::function<void()> task;
+				while (_tasks.Pop(task))
+					task();
+			});
+		}
+	}
+
+
+	ThreadPool::~ThreadPool()
+	{
+		_tasks.Close();
+
+		for (auto& worker : _workers)
+			worker.join();
+	}
+
+
+	std::future<void> ThreadPool::Submit(std::function<void()> task)
+	{
+		auto packagedTask = std::make_shared<std::packaged_task<void()>>(std::move(task));
+		std::future<void> result = packagedTask->get_future();
+
+		_tasks.Push([packagedTask]() { (*packagedTask)(); });
+		return result;
+	}
+
+
+	void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& task)
+	{
+		std::vector<std::future<void>> results;
+		results.reserve(count);
+
+		for (size_t index = 0; index < count; ++index)
+			results.push_back(Submit([&task, index]() { task(index); }));
+
+		// Every task has to finish before the captured references go away
+		for (auto& result : results)
+			result.wait();
+
+		for (auto& result : results)
+			result.get();
+	}
+
+}
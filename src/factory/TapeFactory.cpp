@@ -1,5 +1,7 @@
 #include "factory/TapeFactory.h"
 
+#include <filesystem>
+
 #include "Tape.h"
 
 namespace TestTask
@@ -14,4 +16,10 @@ namespace TestTask
 	std::unique_ptr<ITape> TapeFactory::Create(std::string tapeName)
 	{ return std::unique_ptr<Tape>(new Tape(_pathToWorkDirectory + tapeName, _readWriteDelay, _rewindDelay)); }
 
+	std::unique_ptr<ITape> TapeFactory::Open(const std::string& tapePath)
+	{ return std::unique_ptr<Tape>(new Tape(tapePath, _readWriteDelay, _rewindDelay)); }
+
+	bool TapeFactory::Exists(const std::string& tapeName) const
+	{ return std::filesystem::exists(_pathToWorkDirectory + tapeName); }
+
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "factory/TemporaryTapeFactory.h"
 
+#include <filesystem>
+
 #include "Tape.h"
 
 namespace TestTask
@@ -8,18 +10,18 @@ namespace TestTask
 	TemporaryTapeFactory::TemporaryTapeFactory(uint32_t readWriteDelay, uint32_t rewindDelay, const std::string& pathToWorkDirectory)
 		:	_readWriteDelay(readWriteDelay),
 			_rewindDelay(rewindDelay),
-			_pathToTempDirectory(pathToWorkDirectory + "/tmp/"),
-			_tempTapeNumbers(0)
+			_pathToTempDirectory(pathToWorkDirectory + "/tmp/")
 	{ }
 
 
 	std::unique_ptr<ITape> TemporaryTapeFactory::Create(std::string tapeName)
-	{
-		const std::string fileName = _pathToTempDirectory + tapeName + std::to_string(_tempTapeNumbers);
-		std::unique_ptr<Tape> tape(new Tape(fileName, _readWriteDelay, _rewindDelay));
+	{ return std::unique_ptr<Tape>(new Tape(_pathToTempDirectory + tapeName, _readWriteDelay, _rewindDelay)); }
+
+
+	std::unique_ptr<ITape> TemporaryTapeFactory::Open(const std::string& tapePath)
+	{ return std::unique_ptr<Tape>(new Tape(tapePath, _readWriteDelay, _rewindDelay)); }
 
-		++_tempTapeNumbers;
 
-		return tape;
-	}
+	bool TemporaryTapeFactory::Exists(const std::string& tapeName) const
+	{ return std::filesystem::exists(_pathToTempDirectory + tapeName); }
 }
\ No newline at end of file
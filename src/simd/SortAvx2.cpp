@@ -0,0 +1,59 @@
+#include "simd/SimdSortKernels.h"
+
+#include <immintrin.h>
+
+#include "simd/BitonicSortKernel.h"
+
+namespace TestTask
+{
+
+	namespace
+	{
+		struct Avx2Vector
+		{
+			using Vector = __m256i;
+			using Mask = __m256i;
+
+			constexpr static size_t Lanes = Simd::Avx2Lanes;
+			constexpr static size_t Levels = 3;
+
+			static Vector Load(const int32_t* data)
+			{ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)); }
+
+			static void Store(int32_t* data, Vector vector)
+			{ _mm256_storeu_si256(reinterpret_cast<__m256i*>(data), vector); }
+
+			static Vector Min(Vector left, Vector right)
+			{ return _mm256_min_epi32(left, right); }
+
+			static Vector Max(Vector left, Vector right)
+			{ return _mm256_max_epi32(left, right); }
+
+			static Vector Permute(Vector vector, Vector index)
+			{ return _mm256_permutevar8x32_epi32(vector, index); }
+
+			static Vector Blend(Vector left, Vector right, Mask mask)
+			{ return _mm256_blendv_epi8(left, right, mask); }
+
+			static Vector MakeIndex(const int32_t* index)
+			{ return Load(index); }
+
+			static Mask MakeMask(const bool* flags)
+			{
+				int32_t mask[Lanes];
+				for (size_t lane = 0; lane < Lanes; ++lane)
+					mask[lane] = flags[lane] ? -1 : 0;
+
+				return Load(mask);
+			}
+		};
+	}
+
+
+	void Simd::SortAvx2(int32_t* data, size_t size, int32_t* scratch)
+	{
+		static const Simd::BitonicSortKernel<Avx2Vector> kernel;
+		kernel.Sort(data, size, scratch);
+	}
+
+}
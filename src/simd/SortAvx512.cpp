@@ -0,0 +1,62 @@
+#include "simd/SimdSortKernels.h"
+
+#include <immintrin.h>
+
+#include "simd/BitonicSortKernel.h"
+
+namespace TestTask
+{
+
+	namespace
+	{
+		struct Avx512Vector
+		{
+			using Vector = __m512i;
+			using Mask = __mmask16;
+
+			constexpr static size_t Lanes = Simd::Avx512Lanes;
+			constexpr static size_t Levels = 4;
+
+			static Vector Load(const int32_t* data)
+			{ return _mm512_loadu_si512(data); }
+
+			static void Store(int32_t* data, Vector vector)
+			{ _mm512_storeu_si512(data, vector); }
+
+			static Vector Min(Vector left, Vector right)
+			{ return _mm512_min_epi32(left, right); }
+
+			static Vector Max(Vector left, Vector right)
+			{ return _mm512_max_epi32(left, right); }
+
+			static Vector Permute(Vector vector, Vector index)
+			{ return _mm512_permutexvar_epi32(index, vector); }
+
+			static Vector Blend(Vector left, Vector right, Mask mask)
+			{ return _mm512_mask_blend_epi32(mask, left, right); }
+
+			static Vector MakeIndex(const int32_t* index)
+			{ return Load(index); }
+
+			static Mask MakeMask(const bool* flags)
+			{
+				Mask mask = 0;
+				for (size_t lane = 0; lane < Lanes; ++lane)
+				{
+					if (flags[lane])
+						mask |= static_cast<Mask>(1u << lane);
+				}
+
+				return mask;
+			}
+		};
+	}
+
+
+	void Simd::SortAvx512(int32_t* data, size_t size, int32_t* scratch)
+	{
+		static const Simd::BitonicSortKernel<Avx512Vector> kernel;
+		kernel.Sort(data, size, scratch);
+	}
+
+}
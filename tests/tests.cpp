@@ -3,11 +3,29 @@
 
 #include <exception>
 #include <limits>
+#include <mutex>
+#include <numeric>
 #include <random>
+#include <sstream>
+#include <thread>
 #include <vector>
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 #include "json.hpp"
+#include "ChunkSorter.h"
+#include "LoserTree.h"
+#include "MemoryGovernor.h"
+#include "MergeStreams.h"
+#include "Ordering.h"
+#include "RunDirectory.h"
+#include "SimdSort.h"
 #include "Sort.h"
+#include "SortDaemon.h"
+#include "SortPlanner.h"
+#include "SortScheduler.h"
 
 namespace
 {
@@ -27,6 +45,82 @@ namespace
 		for (const auto& entry : std::filesystem::directory_iterator(dir))
 			std::filesystem::remove_all(entry.path());
 	}
+
+	std::vector<int32_t> WriteRandomSample(const std::string& filePath, size_t dataSize)
+	{
+		std::random_device rd;
+		std::mt19937 gen{rd()};
+		std::uniform_int_distribution<> dataDistribution{std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()};
+
+		std::ofstream sampleFile(filePath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+		std::vector<int32_t> dataSample;
+		for (size_t i = 0; i < dataSize; ++i)
+		{
+			int32_t data = dataDistribution(gen);
+			sampleFile.write(reinterpret_cast<char*>(&data), sizeof(int32_t));
+			dataSample.push_back(data);
+		}
+
+		return dataSample;
+	}
+
+	// Input that fails outside the cells it may read, like a sort that dies midway
+	class InterruptedTape : public TestTask::OrderedTape<TestTask::Ascending>
+	{
+	private:
+		size_t		_firstCell;
+		size_t		_lastCell;
+
+	public:
+		InterruptedTape(std::unique_ptr<TestTask::ITape> tape, size_t firstCell, size_t lastCell)
+			:	OrderedTape(std::move(tape)),
+				_firstCell(firstCell),
+				_lastCell(lastCell)
+		{ }
+
+		int32_t Read(size_t cellNumber) override
+		{
+			if (cellNumber < _firstCell || cellNumber > _lastCell)
+				throw std::runtime_error("Interrupted at cell " + std::to_string(cellNumber));
+
+			return OrderedTape::Read(cellNumber);
+		}
+	};
+
+	// Temporary tape factory that fails once the given number of tapes is created
+	class InterruptedTapeFactory : public TestTask::AbstractTapeFactory
+	{
+	private:
+		std::shared_ptr<TestTask::AbstractTapeFactory>	_factory;
+		size_t											_remainingTapes;
+		std::mutex										_mutex;
+
+	public:
+		InterruptedTapeFactory(const std::shared_ptr<TestTask::AbstractTapeFactory>& factory, size_t tapesCount)
+			:	_factory(factory),
+				_remainingTapes(tapesCount)
+		{ }
+
+		// The merges of a parallel pass create their tapes at the same time
+		std::unique_ptr<TestTask::ITape> Create(std::string tapeName) override
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (_remainingTapes == 0)
+					throw std::runtime_error("Interrupted at tape " + tapeName);
+
+				--_remainingTapes;
+			}
+			return _factory->Create(tapeName);
+		}
+
+		std::unique_ptr<TestTask::ITape> Open(const std::string& tapePath) override
+		{ return _factory->Open(tapePath); }
+
+		bool Exists(const std::string& tapeName) const override
+		{ return _factory->Exists(tapeName); }
+	};
 }
 
 class TestTaskCase : public ::testing::Test
@@ -121,6 +215,51 @@ protected:
 		sampleFile.close();
 	}
 
+	static void SortAndCheck(size_t dataSize, size_t sortRamSize, const TestTask::SortOptions& options)
+	{
+		std::vector<int32_t> expected = WriteRandomSample(inputSortSampleFilePath, dataSize);
+		std::sort(expected.begin(), expected.end());
+		CheckSort(expected, sortRamSize, options, TestTask::Ordering::Ascending);
+	}
+
+	static void SortAndCheck(const std::vector<int32_t>& data, size_t sortRamSize, const TestTask::SortOptions& options)
+	{
+		std::vector<int32_t> expected = data;
+		std::sort(expected.begin(), expected.end());
+		SortAndCheck(data, expected, sortRamSize, options);
+	}
+
+	// Sorts the data and checks that the output is the expected one, for the orderings and the options that change it
+	static void SortAndCheck(const std::vector<int32_t>& data, const std::vector<int32_t>& expected, size_t sortRamSize,
+		const TestTask::SortOptions& options, TestTask::Ordering ordering = TestTask::Ordering::Ascending)
+	{
+		std::fstream sampleFile(inputSortSampleFilePath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		for (const int32_t value : data)
+			Write(sampleFile, value);
+		sampleFile.close();
+
+		CheckSort(expected, sortRamSize, options, ordering);
+	}
+
+	static void CheckSort(const std::vector<int32_t>& expected, size_t sortRamSize, const TestTask::SortOptions& options, TestTask::Ordering ordering)
+	{
+		// The output tape is left from an earlier sort, none of its cells may stay past the sorted ones
+		WriteRandomSample(samplesDirectoryPath + outputSortSamplePath, expected.size() + 100);
+
+		TestTask::Sort sort(tempTapeFactory, sortRamSize, numberOfTemporaryTapes, options);
+		const auto inputTape = tapeFactory->Create(inputSortSamplePath);
+		const auto outputTape = tapeFactory->Create(outputSortSamplePath);
+
+		sort.SortData(inputTape, outputTape, ordering);
+
+		EXPECT_EQ(sort.OutputLength(), expected.size());
+		ASSERT_EQ(outputTape->Length(), expected.size());
+		for(size_t i = 0; i < expected.size(); ++i)
+			EXPECT_EQ(outputTape->Read(i + 1), expected.at(i));
+
+		ClearFolder(temporaryDirectoryPath);
+	}
+
 public:
 	static void init(const std::string& configFilePath)
 	{ configurationFilePath = configFilePath; }
@@ -249,6 +388,101 @@ TEST_F(TestTaskCase, WriteDataToTapeTest)
 }
 
 
+TEST_F(TestTaskCase, BlockTransferTest)
+{
+	const std::string blockSamplePath = "/blockSample";
+	std::filesystem::remove(samplesDirectoryPath + blockSamplePath);
+	auto tape = tapeFactory->Create(blockSamplePath);
+
+	const std::vector<int32_t> data = {5, -1, 7, 3, 9, 0, 2};
+	tape->WriteBlock(data.data(), 4);
+	tape->WriteBlock(data.data() + 4, 3);
+	EXPECT_EQ(tape->Length(), data.size());
+	EXPECT_EQ(tape->CurrentPosition(), data.size() + 1);
+
+	std::vector<int32_t> block(data.size());
+	tape->RewindTape(TestTask::Position::Begin);
+	tape->ReadBlock(block.data(), 3, TestTask::Direction::Forward);
+	EXPECT_EQ(tape->CurrentPosition(), 4);
+	tape->ReadBlock(block.data() + 3, 4, TestTask::Direction::Forward);
+	EXPECT_EQ(block, data);
+
+	tape->RewindTape(5);
+	tape->ReadBlock(block.data(), 3, TestTask::Direction::Backward);
+	EXPECT_EQ(tape->CurrentPosition(), 2);
+	EXPECT_EQ(std::vector<int32_t>(block.begin(), block.begin() + 3), std::vector<int32_t>({9, 3, 7}));
+
+	tape->ReadBlock(block.data(), 2, TestTask::Direction::Backward);
+	EXPECT_EQ(tape->CurrentPosition(), 1);
+	EXPECT_EQ(block[0], -1);
+	EXPECT_EQ(block[1], 5);
+
+	tape->RewindTape(3);
+	EXPECT_EQ(tape->ReadFromCurrentCell(), 7);
+}
+
+
+TEST_F(TestTaskCase, MergeInputsPrefetchTest)
+{
+	const std::vector<std::vector<int32_t>> runs = {
+		{-4, 1, 2, 8, 9, 15, 20},
+		{30, 11, 7, 6, 0, -9},
+		{3, 3, 3, 4, 5, 40}
+	};
+
+	std::vector<std::unique_ptr<TestTask::ITape>> tapes;
+	std::vector<int32_t> expected;
+	TestTask::ThreadPool prefetchThread(1);
+
+	for (bool prefetch : {false, true})
+	{
+		tapes.clear();
+		TestTask::MergeInputs inputs(runs.size(), 2, prefetch ? &prefetchThread : nullptr);
+
+		for (size_t idx = 0; idx < runs.size(); ++idx)
+		{
+			const std::string mergeSamplePath = "/mergeSample" + std::to_string(idx);
+			std::filesystem::remove(samplesDirectoryPath + mergeSamplePath);
+			tapes.push_back(tapeFactory->Create(mergeSamplePath));
+			tapes.back()->WriteBlock(runs[idx].data(), runs[idx].size());
+
+			TestTask::Run run;
+			run.firstCell = 1;
+			run.length = runs[idx].size();
+			run.descending = idx == 1;
+			inputs.Add(*tapes.back(), run);
+
+			expected.insert(expected.end(), runs[idx].begin(), runs[idx].end());
+		}
+		std::sort(expected.begin(), expected.end());
+
+		int32_t value = 0;
+		TestTask::LoserTree tree;
+		tree.Reset(inputs.Count());
+		for (size_t source = 0; source < inputs.Count(); ++source)
+		{
+			if (inputs.Next(source, value))
+				tree.Set(source, value);
+		}
+		tree.Build();
+
+		std::vector<int32_t> merged;
+		while (!tree.Empty())
+		{
+			merged.push_back(tree.Top());
+
+			if (inputs.Next(tree.TopSource(), value))
+				tree.ReplaceTop(value);
+			else
+				tree.PopTop();
+		}
+
+		EXPECT_EQ(merged, expected);
+		expected.clear();
+	}
+}
+
+
 TEST_F(TestTaskCase, SortDataTest)
 {
 	std::random_device rd;
@@ -295,6 +529,1117 @@ TEST_F(TestTaskCase, SortDataTest)
 }
 
 
+TEST_F(TestTaskCase, MultiPassMergeTest)
+{
+	// Two elements of RAM and four open temporary tapes force a two-way merge over several passes
+	TestTask::SortOptions options;
+	options.maxOpenTapes = 4;
+
+	SortAndCheck(200, 2 * sizeof(int32_t), options);
+}
+
+
+TEST_F(TestTaskCase, ParallelSeriesMergeTest)
+{
+	TestTask::SortOptions options;
+	options.parallelTapeDrives = 4;
+
+	SortAndCheck(1000, 16 * sizeof(int32_t), options);
+}
+
+
+TEST_F(TestTaskCase, PipelinedSplitTest)
+{
+	TestTask::SortOptions options;
+	options.pipelinedSplit = true;
+
+	SortAndCheck(300, 10 * sizeof(int32_t), options);
+	SortAndCheck(3000, 2048 * sizeof(int32_t), options);
+}
+
+
+TEST_F(TestTaskCase, ParallelSplitTest)
+{
+	TestTask::SortOptions options;
+	options.splitThreads = 3;
+	options.tapeCost.readWriteDelay = 1;
+
+	const TestTask::Sort sort(tempTapeFactory, 60 * sizeof(int32_t), numberOfTemporaryTapes, options);
+	EXPECT_EQ(sort.Plan(1000).splitThreads, std::min<size_t>(3, numberOfTemporaryTapes));
+
+	SortAndCheck(1000, 60 * sizeof(int32_t), options);
+	SortAndCheck(1013, 20 * sizeof(int32_t), options);
+}
+
+
+TEST_F(TestTaskCase, OrderingSortTest)
+{
+	std::vector<int32_t> dataSample = WriteRandomSample(inputSortSampleFilePath, 3000);
+	dataSample.push_back(std::numeric_limits<int32_t>::min());
+	dataSample.push_back(std::numeric_limits<int32_t>::max());
+	dataSample.push_back(0);
+	dataSample.push_back(-1);
+
+	std::vector<int32_t> descending = dataSample;
+	std::sort(descending.begin(), descending.end(), std::greater<int32_t>());
+
+	std::vector<int32_t> unsignedAscending = dataSample;
+	std::sort(unsignedAscending.begin(), unsignedAscending.end(), [](int32_t first, int32_t second)
+	{ return static_cast<uint32_t>(first) < static_cast<uint32_t>(second); });
+
+	TestTask::SortOptions naturalRunsOptions;
+	naturalRunsOptions.naturalRuns = true;
+
+	TestTask::SortOptions parallelOptions;
+	parallelOptions.splitThreads = 2;
+	parallelOptions.pipelinedSplit = true;
+
+	const std::vector<std::pair<size_t, TestTask::SortOptions>> configurations = {
+		{dataSample.size() * sizeof(int32_t), TestTask::SortOptions()},
+		{100 * sizeof(int32_t), TestTask::SortOptions()},
+		{100 * sizeof(int32_t), naturalRunsOptions},
+		{100 * sizeof(int32_t), parallelOptions}
+	};
+
+	for (const auto& [sortRamSize, options] : configurations)
+	{
+		SortAndCheck(dataSample, descending, sortRamSize, options, TestTask::Ordering::Descending);
+		SortAndCheck(dataSample, unsignedAscending, sortRamSize, options, TestTask::Ordering::UnsignedAscending);
+	}
+
+	// An input already in unsigned order, which the natural runs split finds presorted
+	SortAndCheck(unsignedAscending, unsignedAscending, 100 * sizeof(int32_t), naturalRunsOptions, TestTask::Ordering::UnsignedAscending);
+}
+
+
+TEST_F(TestTaskCase, UniqueSortTest)
+{
+	std::mt19937 gen{11};
+	std::uniform_int_distribution<int32_t> dataDistribution(-300, 300);
+
+	std::vector<int32_t> data;
+	for (size_t i = 0; i < 4000; ++i)
+		data.push_back(dataDistribution(gen));
+
+	// A presorted prefix with repeats for the natural runs split
+	std::vector<int32_t> presorted(data.begin(), data.begin() + 500);
+	std::sort(presorted.begin(), presorted.end());
+	std::copy(presorted.begin(), presorted.end(), data.begin());
+
+	std::vector<int32_t> expected = data;
+	std::sort(expected.begin(), expected.end());
+	expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+
+	std::vector<TestTask::SortOptions> optionsList(5);
+	for (TestTask::SortOptions& options : optionsList)
+		options.unique = true;
+	optionsList[1].naturalRuns = true;
+	optionsList[2].pipelinedSplit = true;
+	optionsList[3].splitThreads = 2;
+	optionsList[4].parallelTapeDrives = 2;
+
+	for (const size_t sortRamSize : {data.size() * sizeof(int32_t), 64 * sizeof(int32_t)})
+	{
+		for (const TestTask::SortOptions& options : optionsList)
+			SortAndCheck(data, expected, sortRamSize, options);
+	}
+}
+
+
+TEST_F(TestTaskCase, RunLengthEncodingTest)
+{
+	const std::string encodedSamplePath = "/encodedSample";
+	std::filesystem::remove(samplesDirectoryPath + encodedSamplePath);
+	auto tape = tapeFactory->Create(encodedSamplePath);
+
+	const std::vector<int32_t> run = {7, 7, 7, 3, 3, -1, -1, -1, -1, -8};
+	TestTask::ThreadPool writerThread(1);
+	TestTask::RunWriter writer(*tape, 3, &writerThread, true, false);
+	for (const int32_t value : run)
+		writer.Put(value);
+	writer.Put(-8, 5);
+	EXPECT_EQ(writer.Finish(), 8);
+	EXPECT_EQ(tape->Length(), 8);
+
+	for (const bool descending : {false, true})
+	{
+		TestTask::Run encodedRun;
+		encodedRun.firstCell = 1;
+		encodedRun.length = tape->Length();
+		encodedRun.descending = descending;
+
+		TestTask::MergeInputs inputs(1, 3, nullptr);
+		inputs.Add(*tape, encodedRun);
+
+		std::vector<std::pair<int32_t, size_t>> pairs;
+		int32_t value;
+		size_t count;
+		while (inputs.NextPair(0, value, count))
+			pairs.emplace_back(value, count);
+
+		std::vector<std::pair<int32_t, size_t>> expected = {{7, 3}, {3, 2}, {-1, 4}, {-8, 6}};
+		if (descending)
+			std::reverse(expected.begin(), expected.end());
+		EXPECT_EQ(pairs, expected);
+	}
+
+	// Few distinct values in long stretches, sorted through every split mode
+	std::mt19937 gen{5};
+	std::uniform_int_distribution<int32_t> valueDistribution(-20, 20);
+	std::uniform_int_distribution<size_t> stretchDistribution(1, 200);
+
+	std::vector<int32_t> data;
+	while (data.size() < 6000)
+		data.insert(data.end(), stretchDistribution(gen), valueDistribution(gen));
+
+	std::vector<TestTask::SortOptions> optionsList(6);
+	for (TestTask::SortOptions& options : optionsList)
+		options.runLengthEncoding = true;
+	optionsList[1].naturalRuns = true;
+	optionsList[2].pipelinedSplit = true;
+	optionsList[3].splitThreads = 2;
+	optionsList[4].parallelTapeDrives = 2;
+	optionsList[5].unique = true;
+
+	std::vector<int32_t> uniqueData = data;
+	std::sort(uniqueData.begin(), uniqueData.end());
+	uniqueData.erase(std::unique(uniqueData.begin(), uniqueData.end()), uniqueData.end());
+
+	for (const TestTask::SortOptions& options : optionsList)
+	{
+		if (options.unique)
+			SortAndCheck(data, uniqueData, 64 * sizeof(int32_t), options);
+		else
+			SortAndCheck(data, 64 * sizeof(int32_t), options);
+	}
+}
+
+
+TEST_F(TestTaskCase, TopKSortTest)
+{
+	std::mt19937 gen{3};
+	std::uniform_int_distribution<int32_t> dataDistribution(-1000, 1000);
+
+	std::vector<int32_t> data;
+	for (size_t i = 0; i < 5000; ++i)
+		data.push_back(dataDistribution(gen));
+
+	// A presorted prefix longer than K
+	std::sort(data.begin(), data.begin() + 800);
+
+	// A descending natural run longer than RAM in the middle, holding the smallest elements
+	std::vector<int32_t> descendingRun(1000);
+	for (size_t i = 0; i < descendingRun.size(); ++i)
+		descendingRun[i] = 500 - 2 * static_cast<int32_t>(i);
+	data.insert(data.begin() + 2500, descendingRun.begin(), descendingRun.end());
+
+	std::vector<int32_t> sorted = data;
+	std::sort(sorted.begin(), sorted.end());
+	std::vector<int32_t> sortedUnique = sorted;
+	sortedUnique.erase(std::unique(sortedUnique.begin(), sortedUnique.end()), sortedUnique.end());
+
+	const size_t sortRamSize = 100 * sizeof(int32_t);
+	for (const size_t topK : {1, 37, 100, 500, 4999, 6000})
+	{
+		std::vector<TestTask::SortOptions> optionsList(6);
+		for (TestTask::SortOptions& options : optionsList)
+			options.topK = topK;
+		optionsList[1].naturalRuns = true;
+		optionsList[2].runLengthEncoding = true;
+		optionsList[3].parallelTapeDrives = 2;
+		optionsList[4].unique = true;
+		optionsList[5].naturalRuns = true;
+		optionsList[5].unique = true;
+
+		for (const TestTask::SortOptions& options : optionsList)
+		{
+			const bool heapSelection = !options.unique && topK <= sortRamSize / sizeof(int32_t);
+			const TestTask::Sort sort(tempTapeFactory, sortRamSize, numberOfTemporaryTapes, options);
+			EXPECT_EQ(sort.Plan(data.size()).algorithm == TestTask::SortPlan::Algorithm::TopK, heapSelection);
+
+			const std::vector<int32_t>& expectedSorted = options.unique ? sortedUnique : sorted;
+			const std::vector<int32_t> expected(expectedSorted.begin(), expectedSorted.begin() + std::min(topK, expectedSorted.size()));
+			SortAndCheck(data, expected, sortRamSize, options);
+		}
+	}
+}
+
+
+TEST_F(TestTaskCase, MergeTapesTest)
+{
+	std::mt19937 gen{13};
+	std::uniform_int_distribution<int32_t> dataDistribution(-500, 500);
+	std::uniform_int_distribution<size_t> sizeDistribution(0, 300);
+
+	// More sorted inputs than the fan-in, one of them empty and one above all the others
+	std::vector<std::vector<int32_t>> inputs(11);
+	for (size_t idx = 0; idx < inputs.size(); ++idx)
+	{
+		if (idx == 3)
+			continue;
+
+		const size_t size = sizeDistribution(gen);
+		for (size_t i = 0; i < size; ++i)
+			inputs[idx].push_back(idx == 7 ? 1000 + dataDistribution(gen) : dataDistribution(gen));
+		std::sort(inputs[idx].begin(), inputs[idx].end());
+	}
+
+	std::vector<std::unique_ptr<TestTask::ITape>> inputTapes;
+	std::vector<int32_t> expected;
+	for (size_t idx = 0; idx < inputs.size(); ++idx)
+	{
+		const std::string mergeInputPath = "/mergeInput" + std::to_string(idx);
+		std::filesystem::remove(samplesDirectoryPath + mergeInputPath);
+
+		auto tape = tapeFactory->Create(mergeInputPath);
+		tape->WriteBlock(inputs[idx].data(), inputs[idx].size());
+		inputTapes.push_back(std::move(tape));
+
+		expected.insert(expected.end(), inputs[idx].begin(), inputs[idx].end());
+	}
+	std::sort(expected.begin(), expected.end());
+
+	// Heads opened by name see the written data once the tapes are flushed
+	for (auto& tape : inputTapes)
+		tape = tapeFactory->Create(tape->Name().substr(samplesDirectoryPath.size()));
+
+	std::vector<TestTask::SortOptions> optionsList(3);
+	optionsList[1].runLengthEncoding = true;
+	optionsList[2].parallelTapeDrives = 2;
+
+	for (const TestTask::SortOptions& options : optionsList)
+	{
+		std::filesystem::remove(samplesDirectoryPath + outputSortSamplePath);
+
+		TestTask::Sort sort(tempTapeFactory, 64 * sizeof(int32_t), numberOfTemporaryTapes, options);
+		const auto outputTape = tapeFactory->Create(outputSortSamplePath);
+		sort.MergeTapes(inputTapes, outputTape, true);
+
+		EXPECT_EQ(sort.OutputLength(), expected.size());
+		ASSERT_EQ(outputTape->Length(), expected.size());
+		for (size_t i = 0; i < expected.size(); ++i)
+			EXPECT_EQ(outputTape->Read(i + 1), expected.at(i));
+
+		ClearFolder(temporaryDirectoryPath);
+	}
+
+	// Inputs sorted in descending order merge with the descending policy
+	std::vector<std::unique_ptr<TestTask::ITape>> descendingTapes;
+	for (size_t idx = 0; idx < 2; ++idx)
+	{
+		std::vector<int32_t> descending = inputs[idx];
+		std::reverse(descending.begin(), descending.end());
+
+		const std::string mergeInputPath = "/mergeInputDescending" + std::to_string(idx);
+		std::filesystem::remove(samplesDirectoryPath + mergeInputPath);
+		tapeFactory->Create(mergeInputPath)->WriteBlock(descending.data(), descending.size());
+		descendingTapes.push_back(tapeFactory->Create(mergeInputPath));
+	}
+
+	std::vector<int32_t> expectedDescending(inputs[0]);
+	expectedDescending.insert(expectedDescending.end(), inputs[1].begin(), inputs[1].end());
+	std::sort(expectedDescending.begin(), expectedDescending.end(), std::greater<int32_t>());
+	{
+		std::filesystem::remove(samplesDirectoryPath + outputSortSamplePath);
+
+		TestTask::Sort sort(tempTapeFactory, 64 * sizeof(int32_t), numberOfTemporaryTapes);
+		const auto outputTape = tapeFactory->Create(outputSortSamplePath);
+		sort.MergeTapes<TestTask::Descending>(descendingTapes, outputTape, true);
+
+		ASSERT_EQ(outputTape->Length(), expectedDescending.size());
+		for (size_t i = 0; i < expectedDescending.size(); ++i)
+			EXPECT_EQ(outputTape->Read(i + 1), expectedDescending.at(i));
+	}
+
+	// An unsorted input fails the verified merge
+	{
+		std::filesystem::remove(samplesDirectoryPath + outputSortSamplePath);
+
+		TestTask::Sort sort(tempTapeFactory, 64 * sizeof(int32_t), numberOfTemporaryTapes);
+		const auto outputTape = tapeFactory->Create(outputSortSamplePath);
+		EXPECT_THROW(sort.MergeTapes(descendingTapes, outputTape, true), std::runtime_error);
+	}
+
+	ClearFolder(temporaryDirectoryPath);
+}
+
+
+TEST_F(TestTaskCase, SortEngineReuseTest)
+{
+	ClearFolder(temporaryDirectoryPath);
+
+	TestTask::SortOptions options;
+	options.strictMemory = true;
+	auto sort = std::make_unique<TestTask::Sort>(tempTapeFactory, 1024 * sizeof(int32_t), numberOfTemporaryTapes, options);
+
+	// A failed merge leaves nothing behind for the next jobs
+	{
+		WriteRandomSample(inputSortSampleFilePath, 100);
+
+		std::vector<std::unique_ptr<TestTask::ITape>> unsortedTapes;
+		unsortedTapes.push_back(tapeFactory->Create(inputSortSamplePath));
+		EXPECT_THROW(sort->MergeTapes(unsortedTapes, tapeFactory->Create("/unsortedOutput"), true), std::runtime_error);
+	}
+
+	// In-memory and external jobs in turn
+	const std::vector<size_t> sizes = {5000, 300, 0, 12000, 1, 900, 5000};
+	for (size_t job = 0; job < sizes.size(); ++job)
+	{
+		std::filesystem::remove(samplesDirectoryPath + inputSortSamplePath);
+		std::filesystem::remove(samplesDirectoryPath + outputSortSamplePath);
+
+		std::vector<int32_t> expected = WriteRandomSample(inputSortSampleFilePath, sizes[job]);
+		std::sort(expected.begin(), expected.end());
+
+		const auto inputTape = tapeFactory->Create(inputSortSamplePath);
+		const auto outputTape = tapeFactory->Create(outputSortSamplePath);
+		sort->SortData(inputTape, outputTape);
+
+		EXPECT_EQ(sort->OutputLength(), expected.size());
+		ASSERT_EQ(outputTape->Length(), expected.size());
+		for (size_t i = 0; i < expected.size(); ++i)
+			EXPECT_EQ(outputTape->Read(i + 1), expected.at(i));
+
+		EXPECT_EQ(sort->Memory().Used(), 0);
+	}
+
+	// The temporary tapes of the external jobs come from one pool, the run directories go with the jobs
+	size_t temporaryTapesCount = 0;
+	for (const auto& entry : std::filesystem::directory_iterator(temporaryDirectoryPath))
+	{
+		EXPECT_NE(entry.path().extension(), ".runs");
+		++temporaryTapesCount;
+	}
+	EXPECT_LE(temporaryTapesCount, 2u * numberOfTemporaryTapes);
+
+	// and the pool goes with the engine
+	sort.reset();
+	EXPECT_TRUE(std::filesystem::is_empty(temporaryDirectoryPath));
+
+	// Neither the inputs nor the outputs of a merge pass that fails on one or several drives outlive the job
+	WriteRandomSample(inputSortSampleFilePath, 5000);
+	for (const size_t parallelTapeDrives : {1, 2})
+	{
+		TestTask::SortOptions failingOptions;
+		failingOptions.parallelTapeDrives = parallelTapeDrives;
+
+		{
+			TestTask::Sort failingSort(std::make_shared<InterruptedTapeFactory>(tempTapeFactory, numberOfTemporaryTapes + 1), 64 * sizeof(int32_t), numberOfTemporaryTapes, failingOptions);
+			EXPECT_GT(failingSort.Plan(5000).mergePasses, 1);
+			EXPECT_THROW(failingSort.SortData(tapeFactory->Create(inputSortSamplePath), tapeFactory->Create(outputSortSamplePath)), std::runtime_error);
+		}
+		for (const auto& entry : std::filesystem::directory_iterator(temporaryDirectoryPath))
+			ADD_FAILURE() << "Left behind " << entry.path();
+	}
+
+	std::filesystem::remove(samplesDirectoryPath + "/unsortedOutput");
+	ClearFolder(temporaryDirectoryPath);
+}
+
+
+TEST_F(TestTaskCase, SortSchedulerTest)
+{
+	// Three engines, but the tapes leave room for one external sort next to one in-memory sort
+	TestTask::SortScheduler::Options options;
+	options.ramSize = 3 * 1024 * sizeof(int32_t);
+	options.jobRamSize = 1024 * sizeof(int32_t);
+	options.threads = 4;
+	options.maxActiveTapes = 2 + 2 * numberOfTemporaryTapes + 2;
+	options.numberOfTemporaryTapes = numberOfTemporaryTapes;
+
+	TestTask::SortScheduler scheduler(tapeFactory, tempTapeFactory, options);
+	EXPECT_EQ(scheduler.EnginesCount(), 3);
+
+	const std::vector<size_t> sizes = {5000, 10, 700, 0, 3000, 1, 1024, 6000, 50, 2000, 300, 4000};
+	std::vector<std::vector<int32_t>> expected;
+	for (size_t job = 0; job < sizes.size(); ++job)
+	{
+		const std::string jobPath = "/scheduledInput" + std::to_string(job);
+		expected.push_back(WriteRandomSample(samplesDirectoryPath + jobPath, sizes[job]));
+		std::sort(expected.back().begin(), expected.back().end());
+
+		const std::string outputPath = "/scheduledOutput" + std::to_string(job);
+		std::filesystem::remove(samplesDirectoryPath + outputPath);
+
+		TestTask::SortJob sortJob{jobPath, outputPath};
+		if (job == 2)
+		{
+			sortJob.ordering = TestTask::Ordering::Descending;
+			std::reverse(expected.back().begin(), expected.back().end());
+		}
+
+		EXPECT_EQ(scheduler.Submit(sortJob), job);
+	}
+
+	const std::vector<TestTask::SortJobResult> results = scheduler.Wait();
+	ASSERT_EQ(results.size(), sizes.size());
+
+	size_t elementsCount = 0;
+	for (size_t job = 0; job < sizes.size(); ++job)
+	{
+		EXPECT_TRUE(results[job].error.empty()) << results[job].error;
+		EXPECT_EQ(results[job].outputLength, sizes[job]);
+		elementsCount += sizes[job];
+
+		const auto outputTape = tapeFactory->Create(results[job].job.outputTape);
+		ASSERT_EQ(outputTape->Length(), sizes[job]);
+		for (size_t i = 0; i < sizes[job]; ++i)
+			EXPECT_EQ(outputTape->Read(i + 1), expected[job].at(i));
+	}
+
+	const TestTask::SchedulerStats stats = scheduler.Stats();
+	EXPECT_EQ(stats.submittedJobs, sizes.size());
+	EXPECT_EQ(stats.completedJobs, sizes.size());
+	EXPECT_EQ(stats.failedJobs, 0);
+	EXPECT_EQ(stats.sortedElements, elementsCount);
+	EXPECT_GT(stats.elementsPerSecond, 0);
+	EXPECT_GE(stats.maxLatencySeconds, stats.meanLatencySeconds);
+	EXPECT_LE(stats.peakActiveJobs, 3);
+	EXPECT_LE(stats.peakActiveTapes, options.maxActiveTapes);
+
+	// A job with a missing input fails instead of sorting an empty tape made up for it
+	const std::string missingPath = "/scheduledMissingInput";
+	std::filesystem::remove(samplesDirectoryPath + missingPath);
+	const size_t missingJob = scheduler.Submit({missingPath, "/scheduledMissingOutput"});
+	EXPECT_EQ(scheduler.Wait().at(missingJob).error, "Input tape " + missingPath + " does not exist");
+	EXPECT_FALSE(std::filesystem::exists(samplesDirectoryPath + missingPath));
+	EXPECT_EQ(scheduler.Stats().failedJobs, 1);
+
+	for (const TestTask::SortJobResult& result : results)
+	{
+		std::filesystem::remove(samplesDirectoryPath + result.job.inputTape);
+		std::filesystem::remove(samplesDirectoryPath + result.job.outputTape);
+	}
+	ClearFolder(temporaryDirectoryPath);
+}
+
+
+TEST_F(TestTaskCase, SortDaemonTest)
+{
+	const std::string socketPath = samplesDirectoryPath + "/sort.sock";
+
+	TestTask::SortDaemon::Options options;
+	options.ramSize = 2 * 1024 * sizeof(int32_t);
+	options.threads = 2;
+	options.numberOfTemporaryTapes = numberOfTemporaryTapes;
+	options.requestTimeout = std::chrono::milliseconds(1000);
+
+	TestTask::SortDaemon daemon(tapeFactory, tempTapeFactory, socketPath, options);
+	std::thread daemonThread([&daemon]() { daemon.Run(); });
+
+	// Clients that send no request wait alone, the others are served in the meantime
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	socketPath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+	const auto connectIdle = [&address]()
+	{
+		const int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+		EXPECT_EQ(connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)), 0);
+		return connection;
+	};
+
+	const auto idleReply = [](int connection)
+	{
+		char reply[256];
+		const ssize_t replyLength = recv(connection, reply, sizeof(reply), 0);
+		close(connection);
+		return std::string(reply, std::max<ssize_t>(replyLength, 0));
+	};
+
+	const int idleConnection = connectIdle();
+
+	// Two sorts on warm engines, the second one in descending order
+	for (const size_t dataSize : {5000, 700})
+	{
+		std::vector<int32_t> expected = WriteRandomSample(inputSortSampleFilePath, dataSize);
+		std::filesystem::remove(samplesDirectoryPath + outputSortSamplePath);
+
+		std::vector<std::string> arguments = {inputSortSamplePath, outputSortSamplePath};
+		if (dataSize == 700)
+		{
+			arguments.push_back("--order=descending");
+			std::sort(expected.begin(), expected.end(), std::greater<int32_t>());
+		}
+		else
+			std::sort(expected.begin(), expected.end());
+
+		std::ostringstream reply;
+		EXPECT_TRUE(TestTask::SendSortRequest(socketPath, arguments, reply)) << reply.str();
+		EXPECT_EQ(reply.str().rfind("progress Sort plan: ", 0), 0) << reply.str();
+		EXPECT_NE(reply.str().find("done outputLength=" + std::to_string(dataSize) + " "), std::string::npos) << reply.str();
+
+		const auto outputTape = tapeFactory->Create(outputSortSamplePath);
+		ASSERT_EQ(outputTape->Length(), dataSize);
+		for (size_t i = 0; i < dataSize; ++i)
+			EXPECT_EQ(outputTape->Read(i + 1), expected.at(i));
+	}
+
+	// A merge of the sorted output with itself
+	{
+		std::filesystem::remove(samplesDirectoryPath + "/daemonMerge");
+
+		std::ostringstream reply;
+		EXPECT_TRUE(TestTask::SendSortRequest(socketPath, {"--merge", "/daemonMerge", outputSortSamplePath, outputSortSamplePath, "--order=descending", "--verify"}, reply)) << reply.str();
+		EXPECT_EQ(tapeFactory->Create("/daemonMerge")->Length(), 1400);
+	}
+
+	// Wrong requests fail without stopping the daemon
+	for (const std::vector<std::string>& arguments : std::vector<std::vector<std::string>>{{"/only"}, {"--batch", "/jobs"}, {"--unknown"}})
+	{
+		std::ostringstream reply;
+		EXPECT_FALSE(TestTask::SendSortRequest(socketPath, arguments, reply));
+		EXPECT_EQ(reply.str().rfind("error ", 0), 0) << reply.str();
+	}
+
+	// The idle client is dropped after the timeout, another one does not hold up the shutdown
+	EXPECT_EQ(idleReply(idleConnection).rfind("error No request within 1000 ms", 0), 0);
+
+	const int shutdownIdleConnection = connectIdle();
+	const auto shutdownStarted = std::chrono::steady_clock::now();
+
+	std::ostringstream reply;
+	EXPECT_TRUE(TestTask::SendSortRequest(socketPath, {"--shutdown"}, reply));
+	daemonThread.join();
+
+	EXPECT_LT(std::chrono::steady_clock::now() - shutdownStarted, options.requestTimeout);
+	EXPECT_EQ(idleReply(shutdownIdleConnection).rfind("error The daemon is shutting down", 0), 0);
+
+	EXPECT_THROW(TestTask::SendSortRequest(socketPath, {"--shutdown"}, reply), std::runtime_error);
+
+	ClearFolder(temporaryDirectoryPath);
+}
+
+
+TEST_F(TestTaskCase, CheckpointResumeTest)
+{
+	const size_t dataSize = 12000;
+	std::vector<int32_t> expected = WriteRandomSample(inputSortSampleFilePath, dataSize);
+	std::sort(expected.begin(), expected.end());
+
+	const size_t sortRamSize = 1024 * sizeof(int32_t);
+
+	std::vector<TestTask::SortOptions> optionsList(3);
+	for (TestTask::SortOptions& options : optionsList)
+		options.checkpoint = true;
+
+	// Tape delays make the planner take the pipelined and the parallel splits
+	optionsList[1].pipelinedSplit = true;
+	optionsList[1].tapeCost.readWriteDelay = 1;
+	optionsList[1].tapeCost.rewindDelay = 1;
+
+	// The parallel and the natural runs splits give way to the sequential one
+	optionsList[2].splitThreads = 2;
+	optionsList[2].naturalRuns = true;
+	optionsList[2].tapeCost = optionsList[1].tapeCost;
+
+	for (const TestTask::SortOptions& options : optionsList)
+	{
+		ClearFolder(temporaryDirectoryPath);
+		std::filesystem::remove(samplesDirectoryPath + outputSortSamplePath);
+
+		const TestTask::SortPlan plan = TestTask::Sort(tempTapeFactory, sortRamSize, numberOfTemporaryTapes, options).Plan(dataSize);
+		EXPECT_EQ(plan.pipelinedSplit, options.pipelinedSplit);
+		EXPECT_EQ(plan.splitThreads, 1);
+
+		const auto outputTape = tapeFactory->Create(outputSortSamplePath);
+		const std::string checkpointPath = outputTape->Name() + ".checkpoint";
+
+		// The first sort dies in the middle of run generation
+		{
+			TestTask::Sort sort(tempTapeFactory, sortRamSize, numberOfTemporaryTapes, options);
+			const std::unique_ptr<TestTask::ITape> inputTape = std::make_unique<InterruptedTape>(tapeFactory->Create(inputSortSamplePath), 1, dataSize / 2);
+			EXPECT_THROW(sort.SortData(inputTape, outputTape), std::runtime_error);
+		}
+		ASSERT_TRUE(std::filesystem::exists(checkpointPath));
+
+		// and cuts the last run line of the manifest short
+		{
+			std::ostringstream manifest;
+			manifest << std::ifstream(checkpointPath).rdbuf();
+			const std::string text = manifest.str();
+
+			const size_t lastLine = text.rfind('\n', text.size() - 2) + 1;
+			ASSERT_EQ(text.compare(lastLine, 4, "run "), 0) << text;
+			std::filesystem::resize_file(checkpointPath, lastLine + (text.size() - lastLine) / 2);
+		}
+
+		// A checkpoint of another input is refused
+		{
+			TestTask::Sort sort(tempTapeFactory, sortRamSize, numberOfTemporaryTapes, options);
+			EXPECT_THROW(sort.SortData(tapeFactory->Create(samplePath), outputTape, true), std::runtime_error);
+		}
+
+		// The second one does not read the first runs again and dies when the first merge pass needs a new tape
+		{
+			TestTask::Sort sort(std::make_shared<InterruptedTapeFactory>(tempTapeFactory, 0), sortRamSize, numberOfTemporaryTapes, options);
+			const std::unique_ptr<TestTask::ITape> inputTape = std::make_unique<InterruptedTape>(tapeFactory->Create(inputSortSamplePath), dataSize / 4, dataSize);
+			EXPECT_THROW(sort.SortData(inputTape, outputTape, true), std::runtime_error);
+		}
+		ASSERT_TRUE(std::filesystem::exists(checkpointPath));
+
+		// The third one only merges
+		{
+			TestTask::Sort sort(tempTapeFactory, sortRamSize, numberOfTemporaryTapes, options);
+			const std::unique_ptr<TestTask::ITape> inputTape = std::make_unique<InterruptedTape>(tapeFactory->Create(inputSortSamplePath), dataSize + 1, dataSize);
+			sort.SortData(inputTape, outputTape, true);
+			EXPECT_EQ(sort.OutputLength(), dataSize);
+		}
+		EXPECT_FALSE(std::filesystem::exists(checkpointPath));
+
+		ASSERT_EQ(outputTape->Length(), dataSize);
+		for (size_t i = 0; i < dataSize; ++i)
+			EXPECT_EQ(outputTape->Read(i + 1), expected.at(i));
+	}
+
+	ClearFolder(temporaryDirectoryPath);
+}
+
+
+TEST_F(TestTaskCase, SortProgressTest)
+{
+	const size_t dataSize = 12000;
+	WriteRandomSample(inputSortSampleFilePath, dataSize);
+
+	TestTask::SortOptions options;
+	options.tapeCost.readWriteDelay = 1;
+	options.tapeCost.rewindDelay = 1;
+	TestTask::Sort sort(tempTapeFactory, 1024 * sizeof(int32_t), numberOfTemporaryTapes, options);
+	const TestTask::SortPlan plan = sort.Plan(dataSize);
+
+	// Without a limit every counted batch is reported
+	std::vector<TestTask::SortProgress> reports;
+	sort.SetProgressCallback([&](const TestTask::SortProgress& progress) { reports.push_back(progress); }, std::chrono::milliseconds(0));
+	sort.SortData(tapeFactory->Create(inputSortSamplePath), tapeFactory->Create(outputSortSamplePath));
+
+	ASSERT_GT(reports.size(), 2 + plan.mergePasses);
+	EXPECT_EQ(reports.front().phase, TestTask::SortProgress::Phase::RunGeneration);
+	EXPECT_EQ(reports.front().processedCells, 0);
+	EXPECT_DOUBLE_EQ(reports.front().remainingTime, plan.predictedTime);
+	EXPECT_EQ(reports.back().phase, TestTask::SortProgress::Phase::Done);
+	EXPECT_EQ(reports.back().processedCells, dataSize);
+	EXPECT_EQ(reports.back().remainingTime, 0);
+
+	size_t pass = 0;
+	for (size_t idx = 1; idx < reports.size(); ++idx)
+	{
+		const TestTask::SortProgress& previous = reports[idx - 1];
+		const TestTask::SortProgress& progress = reports[idx];
+		EXPECT_EQ(progress.totalCells, dataSize);
+		EXPECT_LE(progress.processedCells, dataSize);
+		EXPECT_LE(progress.remainingTime, previous.remainingTime + 1e-6);
+
+		if (progress.phase == TestTask::SortProgress::Phase::Merge)
+		{
+			EXPECT_EQ(progress.passesCount, plan.mergePasses);
+			if (progress.pass != pass)
+			{
+				// Every phase starts from zero after the previous one went through the whole input
+				EXPECT_EQ(progress.pass, pass + 1);
+				EXPECT_EQ(progress.processedCells, 0);
+				EXPECT_EQ(previous.processedCells, dataSize);
+				pass = progress.pass;
+			}
+		}
+	}
+	EXPECT_EQ(pass, plan.mergePasses);
+
+	// Within the interval only the starts of the phases are reported
+	reports.clear();
+	sort.SetProgressCallback([&](const TestTask::SortProgress& progress) { reports.push_back(progress); }, std::chrono::hours(1));
+	sort.SortData(tapeFactory->Create(inputSortSamplePath), tapeFactory->Create(outputSortSamplePath));
+	EXPECT_EQ(reports.size(), 2 + plan.mergePasses);
+
+	std::ostringstream text;
+	text << reports[1];
+	EXPECT_EQ(text.str().rfind("Progress: merge pass 1 of " + std::to_string(plan.mergePasses) + ", 0% of 12000 elements", 0), 0) << text.str();
+
+	// A job with nothing to sort reports its own size, not the one of the previous job
+	WriteRandomSample(inputSortSampleFilePath, 1);
+	reports.clear();
+	sort.SortData(tapeFactory->Create(inputSortSamplePath), tapeFactory->Create(outputSortSamplePath));
+	ASSERT_EQ(reports.size(), 2);
+	EXPECT_EQ(reports.back().phase, TestTask::SortProgress::Phase::Done);
+	EXPECT_EQ(reports.back().totalCells, 1);
+
+	ClearFolder(temporaryDirectoryPath);
+}
+
+
+TEST_F(TestTaskCase, SortPlannerTest)
+{
+	TestTask::SortPlanner::Limits limits;
+	limits.ramDataCapacity = 1000;
+	limits.maxFanIn = 1000;
+	limits.maxOpenTapes = 2000;
+	limits.tapeCost.readWriteDelay = 10;
+	limits.tapeCost.rewindDelay = 20;
+
+	const TestTask::SortPlanner planner(limits);
+
+	const TestTask::SortPlan inMemoryPlan = planner.Plan(limits.ramDataCapacity);
+	EXPECT_EQ(inMemoryPlan.algorithm, TestTask::SortPlan::Algorithm::InMemory);
+
+	// Half-RAM chunks with a scratch buffer would give 1800 runs, more than the fan-in allows
+	const TestTask::SortPlan twoPassPlan = planner.Plan(900 * limits.ramDataCapacity);
+	EXPECT_EQ(twoPassPlan.algorithm, TestTask::SortPlan::Algorithm::ExternalMerge);
+	EXPECT_EQ(twoPassPlan.mergePasses, 1);
+	EXPECT_EQ(twoPassPlan.scratchCapacity, 0);
+	EXPECT_EQ(twoPassPlan.runsCount, 900);
+	EXPECT_GE(twoPassPlan.fanIn, twoPassPlan.runsCount);
+
+	limits.maxFanIn = 4;
+	const TestTask::SortPlan multiPassPlan = TestTask::SortPlanner(limits).Plan(100 * limits.ramDataCapacity);
+	EXPECT_EQ(multiPassPlan.fanIn, 4);
+	EXPECT_EQ(multiPassPlan.runsCount, 100);
+	EXPECT_EQ(multiPassPlan.mergePasses, 4);
+}
+
+
+TEST_F(TestTaskCase, LargeTapeTest)
+{
+	const size_t largeLength = (size_t(1) << 32) + 8;
+
+	TestTask::SortPlanner::Limits limits;
+	limits.ramDataCapacity = size_t(1) << 18;
+	limits.maxFanIn = size_t(1) << 17;
+	limits.maxOpenTapes = size_t(1) << 18;
+
+	// Tens of thousands of runs, each far beyond what 16- and 32-bit counters hold in cells
+	const TestTask::SortPlan plan = TestTask::SortPlanner(limits).Plan(largeLength);
+	EXPECT_EQ(plan.algorithm, TestTask::SortPlan::Algorithm::ExternalMerge);
+	EXPECT_GT(plan.runsCount, std::numeric_limits<uint16_t>::max() / 4);
+	EXPECT_GE(plan.runsCount * plan.chunkCapacity, largeLength);
+	EXPECT_LT((plan.runsCount - 1) * plan.chunkCapacity, largeLength);
+	EXPECT_EQ(plan.mergePasses, 1);
+
+	// A sparse file stands in for a tape of more than 2^32 cells
+	const std::string largeSamplePath = "/largeSample";
+	std::filesystem::remove(samplesDirectoryPath + largeSamplePath);
+	std::ofstream(samplesDirectoryPath + largeSamplePath).close();
+	std::filesystem::resize_file(samplesDirectoryPath + largeSamplePath, largeLength * sizeof(int32_t));
+
+	auto tape = tapeFactory->Create(largeSamplePath);
+	ASSERT_EQ(tape->Length(), largeLength);
+
+	tape->RewindTape(TestTask::Position::End);
+	EXPECT_EQ(tape->CurrentPosition(), largeLength);
+
+	const std::vector<int32_t> runs = {-3, 4, 9, 10, 8, 2, 1, -5};
+	tape->RewindTape(largeLength - runs.size() + 1);
+	tape->WriteBlock(runs.data(), runs.size());
+	EXPECT_EQ(tape->Length(), largeLength);
+
+	TestTask::RunDirectory directory(1);
+	directory.Add(0, {largeLength - 7, 4, -3, 10, false});
+	directory.Add(0, {largeLength - 3, 4, -5, 8, true});
+
+	const std::string path = temporaryDirectoryPath + "/largeDirectory.runs";
+	directory.Save(0, path);
+	directory.Load(0, path);
+	ASSERT_EQ(directory.Runs(0).size(), 2);
+	EXPECT_EQ(directory.Runs(0)[1].firstCell, largeLength - 3);
+
+	// Both heads see the written block once the tape is reopened
+	tape = tapeFactory->Create(largeSamplePath);
+	auto secondHead = tapeFactory->Open(tape->Name());
+	TestTask::ThreadPool prefetchThread(1);
+	TestTask::MergeInputs inputs(2, 3, &prefetchThread);
+	inputs.Add(*tape, directory.Runs(0)[0]);
+	inputs.Add(*secondHead, directory.Runs(0)[1]);
+
+	std::vector<int32_t> merged;
+	int32_t value;
+	for (size_t source = 0; source < inputs.Count(); ++source)
+	{
+		while (inputs.Next(source, value))
+			merged.push_back(value);
+	}
+	EXPECT_EQ(merged, std::vector<int32_t>({-3, 4, 9, 10, -5, 1, 2, 8}));
+
+	tape->RewindTape(TestTask::Position::Begin);
+	EXPECT_EQ(tape->Read(largeLength / 2), 0);
+
+	tape.reset();
+	secondHead.reset();
+	std::filesystem::remove(samplesDirectoryPath + largeSamplePath);
+	ClearFolder(temporaryDirectoryPath);
+}
+
+
+TEST_F(TestTaskCase, AutoPlanSortTest)
+{
+	TestTask::SortOptions options;
+	options.autoPlan = true;
+
+	SortAndCheck(1000, 20 * sizeof(int32_t), options);
+}
+
+
+TEST_F(TestTaskCase, NaturalRunsSortTest)
+{
+	TestTask::SortOptions options;
+	options.naturalRuns = true;
+
+	std::vector<int32_t> data(1000);
+	std::iota(data.begin(), data.end(), -500);
+	SortAndCheck(data, 20 * sizeof(int32_t), options);
+
+	std::reverse(data.begin(), data.end());
+	SortAndCheck(data, 20 * sizeof(int32_t), options);
+
+	// Ascending and descending runs longer than RAM, short runs and random data in between
+	std::mt19937 gen{42};
+	std::uniform_int_distribution<int32_t> valueDistribution{-1000, 1000};
+
+	data.clear();
+	for (size_t block = 0; block < 12; ++block)
+	{
+		const size_t blockSize = 5 + block * 17;
+		std::vector<int32_t> values(blockSize);
+		for (int32_t& value : values)
+			value = valueDistribution(gen);
+
+		if (block % 3 == 0)
+			std::sort(values.begin(), values.end());
+		else if (block % 3 == 1)
+			std::sort(values.rbegin(), values.rend());
+
+		data.insert(data.end(), values.begin(), values.end());
+	}
+	SortAndCheck(data, 20 * sizeof(int32_t), options);
+}
+
+
+TEST_F(TestTaskCase, RunDirectoryTest)
+{
+	TestTask::RunDirectory directory(3);
+	directory.Add(0, {1, 20, -7, 12, false});
+	directory.Add(0, {21, 5, std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max(), true});
+	directory.Add(2, {1, 1, 4, 4, false});
+
+	EXPECT_EQ(directory.SeriesCount(), 2);
+
+	const std::string path = temporaryDirectoryPath + "/directory.runs";
+	directory.Save(0, path);
+
+	TestTask::RunDirectory loaded(1);
+	loaded.Load(0, path);
+	ASSERT_EQ(loaded.Runs(0).size(), 2);
+	EXPECT_EQ(loaded.Runs(0)[1].firstCell, 21);
+	EXPECT_EQ(loaded.Runs(0)[1].length, 5);
+	EXPECT_EQ(loaded.Runs(0)[1].minKey, std::numeric_limits<int32_t>::min());
+	EXPECT_EQ(loaded.Runs(0)[1].maxKey, std::numeric_limits<int32_t>::max());
+	EXPECT_TRUE(loaded.Runs(0)[1].descending);
+
+	ClearFolder(temporaryDirectoryPath);
+
+	// Every chunk covers its own key range, so the series are concatenated instead of merged
+	std::vector<size_t> blocks(50);
+	std::iota(blocks.begin(), blocks.end(), 0);
+	std::mt19937 gen{7};
+	std::shuffle(blocks.begin(), blocks.end(), gen);
+
+	std::vector<int32_t> data;
+	for (const size_t block : blocks)
+	{
+		std::uniform_int_distribution<int32_t> valueDistribution(block * 100, block * 100 + 99);
+		for (size_t i = 0; i < 20; ++i)
+			data.push_back(valueDistribution(gen));
+	}
+	SortAndCheck(data, 20 * sizeof(int32_t), TestTask::SortOptions());
+}
+
+
+TEST_F(TestTaskCase, MemoryGovernorTest)
+{
+	TestTask::MemoryGovernor governor(100);
+	{
+		TestTask::MemoryReservation first = governor.Reserve(60, "first buffer");
+		EXPECT_THROW(governor.Reserve(41, "second buffer"), std::runtime_error);
+
+		const TestTask::MemoryReservation second = governor.Reserve(40, "second buffer");
+		EXPECT_EQ(governor.Available(), 0);
+
+		first.Release();
+		EXPECT_EQ(governor.Used(), 40);
+	}
+	EXPECT_EQ(governor.Used(), 0);
+	EXPECT_EQ(governor.Peak(), 100);
+
+	const size_t dataSize = 5000;
+	const size_t sortRamSize = 4096;
+
+	std::vector<int32_t> dataSample = WriteRandomSample(inputSortSampleFilePath, dataSize);
+	std::sort(dataSample.begin(), dataSample.end());
+	std::filesystem::remove(samplesDirectoryPath + outputSortSamplePath);
+
+	TestTask::SortOptions options;
+	options.strictMemory = true;
+	options.autoPlan = true;
+
+	TestTask::Sort sort(tempTapeFactory, sortRamSize, numberOfTemporaryTapes, options);
+	const auto inputTape = tapeFactory->Create(inputSortSamplePath);
+	const auto outputTape = tapeFactory->Create(outputSortSamplePath);
+	sort.SortData(inputTape, outputTape);
+
+	EXPECT_GT(sort.Memory().Peak(), 0);
+	EXPECT_LE(sort.Memory().Peak(), sortRamSize);
+	EXPECT_EQ(sort.Memory().Used(), 0);
+
+	ASSERT_EQ(outputTape->Length(), dataSize);
+	for(size_t i = 0; i < dataSize; ++i)
+		EXPECT_EQ(outputTape->Read(i + 1), dataSample.at(i));
+
+	ClearFolder(temporaryDirectoryPath);
+
+	// Without room for the run directories there is no plan to fit the limit
+	TestTask::Sort tinySort(tempTapeFactory, 64, numberOfTemporaryTapes, options);
+	const auto tinyOutputTape = tapeFactory->Create(outputSortSamplePath);
+	EXPECT_THROW(tinySort.SortData(inputTape, tinyOutputTape), std::runtime_error);
+
+	ClearFolder(temporaryDirectoryPath);
+}
+
+
+TEST_F(TestTaskCase, LoserTreeMergeTest)
+{
+	const std::vector<std::vector<int32_t>> runs = {
+		{-5, 0, 0, 7},
+		{std::numeric_limits<int32_t>::min(), 3},
+		{},
+		{0, 1, std::numeric_limits<int32_t>::max()},
+		{-5}
+	};
+
+	std::vector<int32_t> expected;
+	std::vector<size_t> positions(runs.size(), 1);
+
+	TestTask::LoserTree tree;
+	tree.Reset(runs.size());
+	for (size_t idx = 0; idx < runs.size(); ++idx)
+	{
+		expected.insert(expected.end(), runs[idx].begin(), runs[idx].end());
+		if (!runs[idx].empty())
+			tree.Set(idx, runs[idx].front());
+	}
+	tree.Build();
+	std::sort(expected.begin(), expected.end());
+
+	std::vector<int32_t> merged;
+	while (!tree.Empty())
+	{
+		merged.push_back(tree.Top());
+
+		const size_t source = tree.TopSource();
+		if (positions[source] < runs[source].size())
+			tree.ReplaceTop(runs[source][positions[source]++]);
+		else
+			tree.PopTop();
+	}
+
+	EXPECT_EQ(merged, expected);
+}
+
+
+TEST_F(TestTaskCase, ChunkSorterTest)
+{
+	std::mt19937 gen{std::random_device{}()};
+	std::uniform_int_distribution<> dataDistribution{std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()};
+	std::uniform_int_distribution<> narrowDistribution{-300, 300};
+
+	// Large enough not to fit into L2 cache, so that the radix sort is taken instead of the SIMD one
+	const size_t dataSize = 1 << 20;
+	TestTask::ChunkSorter sorter(dataSize);
+
+	for (auto* distribution : {&dataDistribution, &narrowDistribution})
+	{
+		std::vector<int32_t> data;
+		for (size_t i = 0; i < dataSize; ++i)
+			data.push_back((*distribution)(gen));
+
+		data.push_back(std::numeric_limits<int32_t>::min());
+		data.push_back(std::numeric_limits<int32_t>::max());
+
+		std::vector<int32_t> expected = data;
+		std::sort(expected.begin(), expected.end());
+
+		// Does not fit into the scratch buffer and falls back to std::sort
+		std::vector<int32_t> fallback = data;
+		sorter.Sort(fallback);
+		EXPECT_EQ(fallback, expected);
+
+		data.resize(dataSize);
+		expected = data;
+		std::sort(expected.begin(), expected.end());
+
+		sorter.Sort(data);
+		EXPECT_EQ(data, expected);
+	}
+}
+
+
+TEST_F(TestTaskCase, ParallelChunkSorterTest)
+{
+	std::mt19937 gen{std::random_device{}()};
+	std::uniform_int_distribution<> narrowDistribution{-1000, 1000};
+
+	const size_t dataSize = 5 * TestTask::ChunkSorter::ParallelSortThreshold + 7;
+
+	for (const size_t threadsCount : {2, 3, 8})
+	{
+		TestTask::ChunkSorter sorter(dataSize, threadsCount);
+
+		std::vector<int32_t> data;
+		for (size_t i = 0; i < dataSize; ++i)
+			data.push_back(narrowDistribution(gen));
+
+		std::vector<int32_t> expected = data;
+		std::sort(expected.begin(), expected.end());
+
+		sorter.Sort(data);
+		EXPECT_EQ(data, expected) << threadsCount << " threads";
+	}
+}
+
+
+TEST_F(TestTaskCase, SimdSortTest)
+{
+	std::mt19937 gen{std::random_device{}()};
+	std::uniform_int_distribution<> dataDistribution{std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()};
+	std::uniform_int_distribution<> narrowDistribution{-5, 5};
+
+	std::vector<TestTask::SimdLevel> levels = {TestTask::SimdLevel::Scalar};
+	const TestTask::SimdLevel supportedLevel = TestTask::DetectSimdLevel();
+	if (supportedLevel != TestTask::SimdLevel::Scalar)
+		levels.push_back(TestTask::SimdLevel::Avx2);
+	if (supportedLevel == TestTask::SimdLevel::Avx512)
+		levels.push_back(TestTask::SimdLevel::Avx512);
+
+	for (const size_t dataSize : {0, 1, 7, 16, 31, 32, 33, 100, 256, 1000, 4099})
+	{
+		for (auto* distribution : {&dataDistribution, &narrowDistribution})
+		{
+			std::vector<int32_t> data;
+			for (size_t i = 0; i < dataSize; ++i)
+				data.push_back((*distribution)(gen));
+
+			std::vector<int32_t> expected = data;
+			std::sort(expected.begin(), expected.end());
+
+			for (const TestTask::SimdLevel level : levels)
+			{
+				std::vector<int32_t> sorted = data;
+				std::vector<int32_t> scratch(dataSize);
+
+				TestTask::SimdSort(sorted.data(), dataSize, scratch.data(), level);
+				EXPECT_EQ(sorted, expected) << "size " << dataSize << ", level " << static_cast<int>(level);
+			}
+		}
+	}
+}
+
+
 int main(int argc, char **argv)
 {
 	if (argc < 2)